@@ -14,21 +14,37 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+#define KBATCH 32 // pages moved between a hart and the pool at once
+#define KHIGH 64  // most free pages a hart keeps to itself
+
 struct run
 {
   struct run *next;
 };
 
-struct
+// Each hart keeps its own list of free pages, refilled from and
+// drained to the global pool KBATCH pages at a time, and steals
+// half of another hart's list when the pool is empty too, so most
+// allocations and frees only take the hart's own lock.
+struct freelist
 {
   struct spinlock lock;
-  struct run *freelist;
-} kmem;
+  struct run *head;
+  int n; // pages on the list
+};
+
+struct freelist kmem;       // the global pool
+struct freelist kcpu[NCPU]; // each hart's own pages
 
+// Reference counts of the pages, shared by copy-on-write
+// mappings. They are updated with atomic instructions rather
+// than under a lock, since fork bumps one for every page.
 int refcnt[PHYSTOP / PGSIZE];
 void kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for (int i = 0; i < NCPU; i++)
+    initlock(&kcpu[i].lock, "kcpu");
   memset(refcnt, 0, sizeof(refcnt));
 
   freerange(end, (void *)PHYSTOP);
@@ -47,69 +63,136 @@ void freerange(void *pa_start, void *pa_end)
 
 void incref(uint64 pa)
 {
-  // acquire the lock
-  acquire(&kmem.lock);
-  int pn = pa / PGSIZE;
-  if (pa > PHYSTOP || refcnt[pn] < 1)
+  if (pa >= PHYSTOP || __sync_fetch_and_add(&refcnt[pa / PGSIZE], 1) < 1)
   {
     panic("increase ref cnt");
   }
-  refcnt[pn]++;
-  release(&kmem.lock);
 }
 
 // Decrement the reference count for a page.
 // If reference count drops to zero, free the page.
-void decref(uint64 pa) {
-  int should_free = 0;
-  
-  acquire(&kmem.lock);
-  if (--refcnt[pa / PGSIZE] == 0) {
-    should_free = 1;  // Mark for freeing after releasing the lock
+void decref(uint64 pa)
+{
+  kfree((void *)pa);
+}
+
+// Take up to n pages off the front of fl and return them as a
+// list, with its last page in *tail and its length in *cnt.
+// Caller must hold fl->lock.
+static struct run *take(struct freelist *fl, int n, struct run **tail, int *cnt)
+{
+  struct run *head = fl->head, *r = 0;
+  int i;
+
+  for (i = 0; i < n && fl->head; i++)
+  {
+    r = fl->head;
+    fl->head = r->next;
   }
-  release(&kmem.lock);
+  if (r)
+    r->next = 0;
+  fl->n -= i;
+  *tail = r;
+  *cnt = i;
+  return i ? head : 0;
+}
+
+// Put the cnt pages from head to tail on the front of fl.
+// Caller must hold fl->lock.
+static void give(struct freelist *fl, struct run *head, struct run *tail, int cnt)
+{
+  tail->next = fl->head;
+  fl->head = head;
+  fl->n += cnt;
+}
 
-  // Free the page if no references remain
-  if (should_free) {
-    kfree((void *)pa);
+// Find pages for the empty list of hart id: a batch from the
+// global pool, or else half of another hart's list. Returns the
+// list, or 0 if there is no free memory left at all.
+static struct run *refill(int id, struct run **tail, int *cnt)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = take(&kmem, KBATCH, tail, cnt);
+  release(&kmem.lock);
+  for (int i = 1; r == 0 && i < NCPU; i++)
+  {
+    struct freelist *fl = &kcpu[(id + i) % NCPU];
+    // Unlocked peek, so that a hart out of memory does not
+    // bounce every other hart's lock.
+    if (fl->n == 0)
+      continue;
+    acquire(&fl->lock);
+    r = take(fl, (fl->n + 1) / 2, tail, cnt);
+    release(&fl->lock);
   }
+  return r;
 }
 
 void kfree(void *pa)
 {
-  struct run *r;
+  struct freelist *fl;
+  struct run *r, *head, *tail;
+  int n, cnt = 0;
   r = (struct run *)pa;
 
   if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
-  acquire(&kmem.lock);
-  int pn = (uint64)r / PGSIZE;
-
-  // Check for valid reference count before decrementing
-  if (refcnt[pn] < 1)
+  // Drop a reference, and only free the page once none are left
+  n = __sync_sub_and_fetch(&refcnt[(uint64)r / PGSIZE], 1);
+  if (n < 0)
     panic("kfree panic: refcount below zero");
-
-  // Decrement reference count
-  refcnt[pn] -= 1;
-
-  // Only free if reference count has reached zero
-  if (refcnt[pn] == 0)
+  if (n > 0)
+    return;
+
+  memset(pa, 1, PGSIZE); // Fill with junk to catch dangling refs
+
+  push_off();
+  fl = &kcpu[cpuid()];
+  acquire(&fl->lock);
+  r->next = fl->head;
+  fl->head = r;
+  fl->n++;
+  head = 0;
+  if (fl->n > KHIGH)
+    head = take(fl, KBATCH, &tail, &cnt);
+  release(&fl->lock);
+  if (head)
   {
-    memset(pa, 1, PGSIZE); // Fill with junk to catch dangling refs
-    r->next = kmem.freelist;
-    kmem.freelist = r;
+    acquire(&kmem.lock);
+    give(&kmem, head, tail, cnt);
+    release(&kmem.lock);
   }
-
-  release(&kmem.lock);
+  pop_off();
 }
 
 void *kalloc(void)
 {
-  struct run *r;
-
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  struct freelist *fl;
+  struct run *r, *tail;
+  int id, cnt;
+
+  push_off();
+  id = cpuid();
+  fl = &kcpu[id];
+  acquire(&fl->lock);
+  r = fl->head;
+  if (r)
+  {
+    fl->head = r->next;
+    fl->n--;
+  }
+  release(&fl->lock);
+  if (r == 0 && (r = refill(id, &tail, &cnt)) != 0 && cnt > 1)
+  {
+    // Keep the first page, and the rest for next time
+    acquire(&fl->lock);
+    give(fl, r->next, tail, cnt - 1);
+    release(&fl->lock);
+  }
+  pop_off();
 
   if (r)
   {
@@ -121,12 +204,7 @@ void *kalloc(void)
 
     // Set reference count to 1 for newly allocated page
     refcnt[pn] = 1;
-    kmem.freelist = r->next;
-  }
-
-  release(&kmem.lock);
-
-  if (r)
     memset((char *)r, 5, PGSIZE); // Fill with junk
+  }
   return (void *)r;
 }
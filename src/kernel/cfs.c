@@ -0,0 +1,358 @@
+// Completely fair scheduling.
+//
+// Each process accumulates virtual runtime: every tick it spends
+// RUNNING adds CFS_SCALE / tickets, so a process with more tickets
+// ages more slowly. The RUNNABLE process with the smallest vruntime
+// always runs next.
+//
+// A process that wakes from sleep is placed slightly ahead of the
+// current minimum, by at most CFS_SLEEP_CREDIT, so I/O-bound jobs
+// run soon after they wake, but cannot bank the time they slept
+// and then starve the CPU-bound ones.
+//
+// RUNNABLE processes live in a red-black tree threaded through
+// struct proc and ordered by (vruntime, pid), so entering and
+// picking are O(log NPROC).
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define CFS_SCALE 1024               // vruntime of one tick at one ticket
+#define CFS_SLEEP_CREDIT (2*CFS_SCALE) // head start for a woken sleeper
+
+struct {
+  struct spinlock lock;
+  struct proc *root;
+  uint64 min_vruntime; // never decreases
+} cfs;
+
+void
+cfsinit(void)
+{
+  initlock(&cfs.lock, "cfs");
+}
+
+// Does a come before b in the tree?
+static int
+less(struct proc *a, struct proc *b)
+{
+  if(a->vruntime != b->vruntime)
+    return a->vruntime < b->vruntime;
+  return a->pid < b->pid;
+}
+
+// Make v take u's place under u's parent.
+static void
+transplant(struct proc *u, struct proc *v)
+{
+  if(u->rbparent == 0)
+    cfs.root = v;
+  else if(u == u->rbparent->rbleft)
+    u->rbparent->rbleft = v;
+  else
+    u->rbparent->rbright = v;
+  if(v)
+    v->rbparent = u->rbparent;
+}
+
+static void
+rotate_left(struct proc *x)
+{
+  struct proc *y = x->rbright;
+
+  x->rbright = y->rbleft;
+  if(y->rbleft)
+    y->rbleft->rbparent = x;
+  transplant(x, y);
+  y->rbleft = x;
+  x->rbparent = y;
+}
+
+static void
+rotate_right(struct proc *x)
+{
+  struct proc *y = x->rbleft;
+
+  x->rbleft = y->rbright;
+  if(y->rbright)
+    y->rbright->rbparent = x;
+  transplant(x, y);
+  y->rbright = x;
+  x->rbparent = y;
+}
+
+static int
+isred(struct proc *p)
+{
+  return p != 0 && p->rbred;
+}
+
+static void
+insert(struct proc *z)
+{
+  struct proc *x = cfs.root, *y = 0, *g, *u;
+
+  while(x){
+    y = x;
+    x = less(z, x) ? x->rbleft : x->rbright;
+  }
+  z->rbparent = y;
+  z->rbleft = z->rbright = 0;
+  z->rbred = 1;
+  if(y == 0)
+    cfs.root = z;
+  else if(less(z, y))
+    y->rbleft = z;
+  else
+    y->rbright = z;
+
+  // Restore the red-black properties.
+  while(isred(z->rbparent)){
+    g = z->rbparent->rbparent;
+    if(z->rbparent == g->rbleft){
+      u = g->rbright;
+      if(isred(u)){
+        z->rbparent->rbred = 0;
+        u->rbred = 0;
+        g->rbred = 1;
+        z = g;
+      } else {
+        if(z == z->rbparent->rbright){
+          z = z->rbparent;
+          rotate_left(z);
+        }
+        z->rbparent->rbred = 0;
+        g->rbred = 1;
+        rotate_right(g);
+      }
+    } else {
+      u = g->rbleft;
+      if(isred(u)){
+        z->rbparent->rbred = 0;
+        u->rbred = 0;
+        g->rbred = 1;
+        z = g;
+      } else {
+        if(z == z->rbparent->rbleft){
+          z = z->rbparent;
+          rotate_right(z);
+        }
+        z->rbparent->rbred = 0;
+        g->rbred = 1;
+        rotate_left(g);
+      }
+    }
+  }
+  cfs.root->rbred = 0;
+}
+
+static void
+erase(struct proc *z)
+{
+  struct proc *x, *xp, *y, *w;
+  int yred = z->rbred;
+
+  if(z->rbleft == 0){
+    x = z->rbright;
+    xp = z->rbparent;
+    transplant(z, x);
+  } else if(z->rbright == 0){
+    x = z->rbleft;
+    xp = z->rbparent;
+    transplant(z, x);
+  } else {
+    for(y = z->rbright; y->rbleft; y = y->rbleft)
+      ;
+    yred = y->rbred;
+    x = y->rbright;
+    if(y->rbparent == z){
+      xp = y;
+    } else {
+      xp = y->rbparent;
+      transplant(y, x);
+      y->rbright = z->rbright;
+      y->rbright->rbparent = y;
+    }
+    transplant(z, y);
+    y->rbleft = z->rbleft;
+    y->rbleft->rbparent = y;
+    y->rbred = z->rbred;
+  }
+  z->rbparent = z->rbleft = z->rbright = 0;
+  if(yred)
+    return;
+
+  // x, possibly null, is short one black node; xp is its parent.
+  while(x != cfs.root && !isred(x)){
+    if(x == xp->rbleft){
+      w = xp->rbright;
+      if(isred(w)){
+        w->rbred = 0;
+        xp->rbred = 1;
+        rotate_left(xp);
+        w = xp->rbright;
+      }
+      if(!isred(w->rbleft) && !isred(w->rbright)){
+        w->rbred = 1;
+        x = xp;
+        xp = x->rbparent;
+      } else {
+        if(!isred(w->rbright)){
+          w->rbleft->rbred = 0;
+          w->rbred = 1;
+          rotate_right(w);
+          w = xp->rbright;
+        }
+        w->rbred = xp->rbred;
+        xp->rbred = 0;
+        w->rbright->rbred = 0;
+        rotate_left(xp);
+        x = cfs.root;
+      }
+    } else {
+      w = xp->rbleft;
+      if(isred(w)){
+        w->rbred = 0;
+        xp->rbred = 1;
+        rotate_right(xp);
+        w = xp->rbleft;
+      }
+      if(!isred(w->rbleft) && !isred(w->rbright)){
+        w->rbred = 1;
+        x = xp;
+        xp = x->rbparent;
+      } else {
+        if(!isred(w->rbleft)){
+          w->rbright->rbred = 0;
+          w->rbred = 1;
+          rotate_left(w);
+          w = xp->rbleft;
+        }
+        w->rbred = xp->rbred;
+        xp->rbred = 0;
+        w->rbleft->rbred = 0;
+        rotate_right(xp);
+        x = cfs.root;
+      }
+    }
+  }
+  if(x)
+    x->rbred = 0;
+}
+
+// Put p into the tree unless it is there already.
+// Caller must hold cfs.lock.
+static void
+queue(struct proc *p)
+{
+  if(!p->rbqueued){
+    insert(p);
+    p->rbqueued = 1;
+  }
+}
+
+// Put a process that is becoming RUNNABLE into the tree. A process
+// new to CFS starts at the current minimum, and a sleeper gets at
+// most CFS_SLEEP_CREDIT ahead of it.
+// Caller must hold p->lock.
+static void
+cfs_enqueue(struct proc *p, int from)
+{
+  uint64 floor;
+
+  acquire(&cfs.lock);
+  floor = cfs.min_vruntime;
+  if(from == SLEEPING)
+    floor = floor > CFS_SLEEP_CREDIT ? floor - CFS_SLEEP_CREDIT : 0;
+  if(from == USED || p->vruntime < floor)
+    p->vruntime = floor;
+  queue(p);
+  release(&cfs.lock);
+}
+
+// A process that was preempted keeps the vruntime it has earned.
+// Caller must hold p->lock.
+static void
+cfs_yield(struct proc *p)
+{
+  acquire(&cfs.lock);
+  queue(p);
+  release(&cfs.lock);
+}
+
+// Take p out of the tree.
+// Caller must hold p->lock.
+static int
+cfs_dequeue(struct proc *p)
+{
+  int queued;
+
+  acquire(&cfs.lock);
+  if((queued = p->rbqueued) != 0){
+    erase(p);
+    p->rbqueued = 0;
+  }
+  release(&cfs.lock);
+  return queued;
+}
+
+// The node after p in tree order, or 0.
+static struct proc*
+successor(struct proc *p)
+{
+  if(p->rbright){
+    for(p = p->rbright; p->rbleft; p = p->rbleft)
+      ;
+    return p;
+  }
+  while(p->rbparent && p == p->rbparent->rbright)
+    p = p->rbparent;
+  return p->rbparent;
+}
+
+// Take the process with the smallest vruntime that may run on
+// cpu c out of the tree, or return 0 if there is none.
+static struct proc*
+cfs_pick(struct cpu *c)
+{
+  struct proc *p;
+  int id = c - cpus;
+
+  acquire(&cfs.lock);
+  if((p = cfs.root) != 0){
+    while(p->rbleft)
+      p = p->rbleft;
+    if(p->vruntime > cfs.min_vruntime)
+      cfs.min_vruntime = p->vruntime;
+    while(p && !ALLOWED(p, id))
+      p = successor(p);
+    if(p){
+      erase(p);
+      p->rbqueued = 0;
+    }
+  }
+  release(&cfs.lock);
+  return p;
+}
+
+// Charge the RUNNING process p for one tick.
+// Called on the cpu running p.
+static void
+cfs_tick(struct proc *p)
+{
+  p->vruntime += CFS_SCALE / (p->tickets > 0 ? p->tickets : 1);
+}
+
+struct sched_class cfs_class = {
+  .name = "cfs",
+  .enqueue = cfs_enqueue,
+  .dequeue = cfs_dequeue,
+  .pick_next = cfs_pick,
+  .tick = cfs_tick,
+  .yield = cfs_yield,
+};
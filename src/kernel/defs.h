@@ -2,6 +2,11 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct mlfq;
+struct procstat;
+struct latstat;
+struct memstat;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -68,6 +73,17 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           kalloc_order(int);
+void            kfree_order(void *, int);
+void            kmemstat(struct memstat*);
+#ifdef MEMTEST
+void            kmemtest(void);
+#endif
+
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint, void (*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -91,7 +107,6 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -111,11 +126,50 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
-void enqueue(int q, struct proc *p);
-struct proc *dequeue(int q) ;
-void remove_from_queue(int q, struct proc *p) ;
+struct proc*    findproc(int);
+void enqueue(struct mlfq *m, int q, struct proc *p);
+struct proc *dequeue(struct mlfq *m, int q) ;
+void remove_from_queue(struct mlfq *m, struct proc *p) ;
 void promote(struct proc *p) ;
 void demote(struct proc *p) ;
+void set_tickets(struct proc *p, int n);
+int             setscheduler(char*);
+int             setdirect(int);
+int             setaffinity(int, int);
+int             getaffinity(int);
+int             getprocstat(int, struct procstat*);
+int             newgroup(int);
+int             fundgroup(int, int);
+int             transfer_tickets(int, int);
+int             setquota(int, int, int);
+void            throttle(void);
+void            inherit_priority(struct proc*);
+void            restore_priority(void);
+int             getlatstat(int, struct latstat*);
+void            mlfq_clock(void);
+int             mlfq_setboost(int);
+// stride.c
+void            strideinit(void);
+struct proc**   stride_resize(struct proc**);
+
+// cfs.c
+void            cfsinit(void);
+
+// edf.c
+void            edfinit(void);
+void            edf_enter(struct proc*);
+struct proc*    edf_pick(struct cpu*);
+void            edf_charge(struct proc*);
+void            edf_tick(void);
+int             setrealtime(int, int, int);
+void            edf_exit(struct proc*);
+
+// timeout.c
+struct proc**   timeout_resize(struct proc**);
+void            timeout_add(struct proc*, uint);
+void            timeout_cancel(struct proc*);
+void            timeout_expire(uint);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -169,6 +223,8 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+int             kvmmappage(uint64, uint64);
+void            kvmunmappage(uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
@@ -0,0 +1,185 @@
+// Earliest-deadline-first real-time class.
+//
+// A process joins the class with setrealtime(runtime, deadline,
+// period), all in ticks: in every period it may run for runtime
+// ticks, and each such job should finish within deadline ticks of
+// the start of its period. Real-time processes are always picked
+// ahead of the normal scheduling policy, earliest absolute deadline
+// first.
+//
+// A process that uses up its runtime is throttled until its next
+// period, so a misbehaving task cannot take more than it reserved.
+// Admission control keeps the summed density, runtime / deadline,
+// of all real-time processes within EDF_MAXBW per mille of one CPU,
+// which global EDF can meet on any number of CPUs.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define EDF_MAXBW 950 // per mille of one CPU
+
+// edf.lock protects the lists, edf.bw and the rt_* fields
+// of every process. Acquire it after p->lock, never before.
+struct {
+  struct spinlock lock;
+  struct proc *ready;     // RUNNABLE, with budget, by rt_absdl
+  struct proc *throttled; // RUNNABLE, waiting for their next period
+  int bw;                 // admitted density, per mille
+} edf;
+
+void
+edfinit(void)
+{
+  initlock(&edf.lock, "edf");
+}
+
+static int
+density(int runtime, int deadline)
+{
+  return runtime * 1000 / deadline;
+}
+
+// Start p's current period, if a new one is due at time now.
+static void
+replenish(struct proc *p, uint now)
+{
+  if(now - p->rt_release < p->rt_period)
+    return;
+  p->rt_release += (now - p->rt_release) / p->rt_period * p->rt_period;
+  p->rt_budget = p->rt_runtime;
+  p->rt_absdl = p->rt_release + p->rt_deadline;
+}
+
+// Link p into the ready list in deadline order.
+static void
+insert_ready(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &edf.ready; *pp && (int)((*pp)->rt_absdl - p->rt_absdl) <= 0;
+      pp = &(*pp)->rtnext)
+    ;
+  p->rtnext = *pp;
+  *pp = p;
+}
+
+// Put a real-time process that has become RUNNABLE on the ready
+// list, or on the throttled list if its budget for this period
+// is gone.
+// Caller must hold p->lock.
+void
+edf_enter(struct proc *p)
+{
+  acquire(&edf.lock);
+  replenish(p, ticks);
+  if(p->rt_budget > 0){
+    insert_ready(p);
+  } else {
+    p->rtnext = edf.throttled;
+    edf.throttled = p;
+  }
+  release(&edf.lock);
+}
+
+// Take the ready real-time process with the earliest deadline
+// among those that may run on cpu c, or return 0 if there is none.
+struct proc*
+edf_pick(struct cpu *c)
+{
+  struct proc **pp, *p;
+  int id = c - cpus;
+
+  if(edf.ready == 0)
+    return 0;
+  acquire(&edf.lock);
+  for(pp = &edf.ready; (p = *pp) != 0 && !ALLOWED(p, id); pp = &p->rtnext)
+    ;
+  if(p)
+    *pp = p->rtnext;
+  release(&edf.lock);
+  return p;
+}
+
+// Charge the RUNNING real-time process p for one tick.
+// Called on the cpu running p.
+void
+edf_charge(struct proc *p)
+{
+  acquire(&edf.lock);
+  replenish(p, ticks);
+  if(p->rt_budget > 0)
+    p->rt_budget--;
+  release(&edf.lock);
+}
+
+// Once per tick: move throttled processes whose next
+// period has started back to the ready list.
+void
+edf_tick(void)
+{
+  struct proc **pp, *p;
+
+  acquire(&edf.lock);
+  for(pp = &edf.throttled; (p = *pp) != 0; ){
+    replenish(p, ticks);
+    if(p->rt_budget > 0){
+      *pp = p->rtnext;
+      insert_ready(p);
+    } else {
+      pp = &p->rtnext;
+    }
+  }
+  release(&edf.lock);
+}
+
+// Make the calling process real-time with the given reservation,
+// or, if runtime is 0, return it to the normal class.
+// Returns -1 if the parameters are invalid or admitting the
+// process would overcommit the real-time class.
+int
+setrealtime(int runtime, int deadline, int period)
+{
+  struct proc *p = myproc();
+  int old, new;
+
+  if(runtime < 0 || (runtime > 0 && (runtime > deadline || deadline > period)))
+    return -1;
+
+  acquire(&p->lock);
+  acquire(&edf.lock);
+  old = p->rt_runtime ? density(p->rt_runtime, p->rt_deadline) : 0;
+  new = runtime ? density(runtime, deadline) : 0;
+  if(edf.bw - old + new > EDF_MAXBW){
+    release(&edf.lock);
+    release(&p->lock);
+    return -1;
+  }
+  edf.bw += new - old;
+  // p is RUNNING, so it is on neither list.
+  p->rt_runtime = runtime;
+  p->rt_deadline = deadline;
+  p->rt_period = period;
+  p->rt_release = ticks;
+  p->rt_budget = runtime;
+  p->rt_absdl = ticks + deadline;
+  release(&edf.lock);
+  release(&p->lock);
+  return 0;
+}
+
+// Give back the exiting process p's reservation.
+// Caller must hold p->lock.
+void
+edf_exit(struct proc *p)
+{
+  acquire(&edf.lock);
+  if(p->rt_runtime)
+    edf.bw -= density(p->rt_runtime, p->rt_deadline);
+  p->rt_runtime = 0;
+  release(&edf.lock);
+}
@@ -1,6 +1,25 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or blocks of 2^order contiguous pages.
+//
+// Free memory is kept by a binary buddy allocator: a block of
+// 2^k pages starts at a page number that is a multiple of 2^k,
+// counting from KERNBASE, and its buddy is the block it was split
+// from or can be merged with, whose page number differs only in
+// bit k. There is a list of free blocks for every order, and
+// kmem.order[] records the order of each free block at its first
+// page, so freeing a block finds out in O(1) if its buddy is free
+// too and merges the two, and so on up.
+//
+// Each hart also keeps its own list of free single pages, so most
+// calls to kalloc() and kfree() only take that hart's lock, which
+// nobody else wants. A hart whose list runs dry refills it with
+// KBATCH pages at once from the buddy allocator, and one whose list
+// grows past KHIGH pages gives KBATCH back. When the buddy
+// allocator is empty as well, a hart steals half the list of
+// another hart. A larger request that finds no block big enough
+// first returns every hart's pages, so they can merge.
 
 #include "types.h"
 #include "param.h"
@@ -8,6 +27,14 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "memstat.h"
+
+#define KBATCH 32 // pages moved between a hart and the pool at once
+#define KHIGH  64 // most free pages a hart keeps to itself
+
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2PG(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PG2PA(i) ((void*)(KERNBASE + (uint64)(i) * PGSIZE))
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -18,35 +45,223 @@ struct run {
   struct run *next;
 };
 
+// A free buddy block, in its first page.
+struct block {
+  struct block *next;
+  struct block *prev;
+};
+
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct block *free[NORDER]; // free blocks of each order
+  int nblock[NORDER];         // how many are on each list
+  int nfree;                  // pages in free blocks
+  int npage;                  // pages handed to the allocator
+  uchar order[NPAGE];         // 1 + order of the free block at page i, or 0
 } kmem;
 
+struct freelist {
+  struct spinlock lock;
+  struct run *head;
+  int n;            // pages on the list
+};
+
+struct freelist kcpu[NCPU];  // each hart's own pages
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcpu[i].lock, "kcpu");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Put free block i of order k on its list.
+// Caller must hold kmem.lock.
+static void
+buddy_insert(uint64 i, int k)
+{
+  struct block *b = PG2PA(i);
+
+  b->prev = 0;
+  b->next = kmem.free[k];
+  if(b->next)
+    b->next->prev = b;
+  kmem.free[k] = b;
+  kmem.nblock[k]++;
+  kmem.order[i] = k + 1;
+}
+
+// Take free block i of order k off its list.
+// Caller must hold kmem.lock.
+static void
+buddy_remove(uint64 i, int k)
+{
+  struct block *b = PG2PA(i);
+
+  if(b->prev)
+    b->prev->next = b->next;
+  else
+    kmem.free[k] = b->next;
+  if(b->next)
+    b->next->prev = b->prev;
+  kmem.nblock[k]--;
+  kmem.order[i] = 0;
+}
+
+// Allocate a block of order k, splitting a larger one if need
+// be, and return its first page number, or -1 if there is none.
+// Caller must hold kmem.lock.
+static int
+buddy_alloc(int k)
+{
+  int i;
+  int j;
+
+  for(j = k; j < NORDER && kmem.free[j] == 0; j++)
+    ;
+  if(j == NORDER)
+    return -1;
+  i = PA2PG(kmem.free[j]);
+  buddy_remove(i, j);
+  // Give back the upper halves we don't need.
+  while(j > k){
+    j--;
+    buddy_insert(i + (1L << j), j);
+  }
+  kmem.nfree -= 1 << k;
+  return i;
+}
+
+// Free block i of order k, merging it with its buddy for as long
+// as the buddy is free too.
+// Caller must hold kmem.lock.
+static void
+buddy_free(uint64 i, int k)
+{
+  uint64 b;
+
+  if(kmem.order[i])
+    panic("buddy_free");
+  kmem.nfree += 1 << k;
+  for(; k < NORDER - 1; k++){
+    b = i ^ (1L << k);
+    if(b >= NPAGE || kmem.order[b] != k + 1)
+      break;
+    buddy_remove(b, k);
+    i &= ~(1L << k);
+  }
+  buddy_insert(i, k);
+}
+
+// Hand the pages from pa_start to pa_end to the allocator, as
+// the largest aligned blocks that fit.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  uint64 i = PA2PG(PGROUNDUP((uint64)pa_start));
+  uint64 n = PA2PG(PGROUNDDOWN((uint64)pa_end));
+  int k;
+
+  acquire(&kmem.lock);
+  while(i < n){
+    for(k = 0; k + 1 < NORDER && (i & ((2L << k) - 1)) == 0 && i + (2L << k) <= n; k++)
+      ;
+    kmem.npage += 1 << k;
+    buddy_free(i, k);
+    i += 1 << k;
+  }
+  release(&kmem.lock);
+}
+
+// Take up to n pages off the front of fl and return them as a
+// list, with its last page in *tail and its length in *cnt.
+// Caller must hold fl->lock.
+static struct run *
+take(struct freelist *fl, int n, struct run **tail, int *cnt)
+{
+  struct run *head = fl->head, *r = 0;
+  int i;
+
+  for(i = 0; i < n && fl->head; i++){
+    r = fl->head;
+    fl->head = r->next;
+  }
+  if(r)
+    r->next = 0;
+  fl->n -= i;
+  *tail = r;
+  *cnt = i;
+  return i ? head : 0;
+}
+
+// Put the cnt pages from head to tail on the front of fl.
+// Caller must hold fl->lock.
+static void
+give(struct freelist *fl, struct run *head, struct run *tail, int cnt)
+{
+  tail->next = fl->head;
+  fl->head = head;
+  fl->n += cnt;
+}
+
+// Find pages for the empty list of hart id: a batch from the
+// buddy allocator, or else half of another hart's list. Returns
+// the list, or 0 if there is no free memory left at all.
+static struct run *
+refill(int id, struct run **tail, int *cnt)
+{
+  struct run *r = 0, *p;
+  int pg;
+
+  *cnt = 0;
+  acquire(&kmem.lock);
+  while(*cnt < KBATCH && (pg = buddy_alloc(0)) >= 0){
+    p = PG2PA(pg);
+    p->next = r;
+    r = p;
+    if(*cnt == 0)
+      *tail = p;
+    (*cnt)++;
+  }
+  release(&kmem.lock);
+  for(int i = 1; r == 0 && i < NCPU; i++){
+    struct freelist *fl = &kcpu[(id + i) % NCPU];
+    // Unlocked peek, so that a hart out of memory does not
+    // bounce every other hart's lock.
+    if(fl->n == 0)
+      continue;
+    acquire(&fl->lock);
+    r = take(fl, (fl->n + 1) / 2, tail, cnt);
+    release(&fl->lock);
+  }
+  return r;
+}
+
+// Give the pages on list r back to the buddy allocator.
+static void
+drain(struct run *r)
+{
+  struct run *next;
+
+  acquire(&kmem.lock);
+  for(; r; r = next){
+    next = r->next;
+    buddy_free(PA2PG(r), 0);
+  }
+  release(&kmem.lock);
 }
 
 // Free the page of physical memory pointed at by pa,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc().
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct freelist *fl;
+  struct run *r, *head, *tail;
+  int cnt;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
@@ -56,10 +271,19 @@ kfree(void *pa)
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  fl = &kcpu[cpuid()];
+  acquire(&fl->lock);
+  r->next = fl->head;
+  fl->head = r;
+  fl->n++;
+  head = 0;
+  if(fl->n > KHIGH)
+    head = take(fl, KBATCH, &tail, &cnt);
+  release(&fl->lock);
+  pop_off();
+  if(head)
+    drain(head);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +292,177 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct freelist *fl;
+  struct run *r, *tail;
+  int id, cnt;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  fl = &kcpu[id];
+  acquire(&fl->lock);
+  r = fl->head;
+  if(r){
+    fl->head = r->next;
+    fl->n--;
+  }
+  release(&fl->lock);
+  if(r == 0 && (r = refill(id, &tail, &cnt)) != 0 && cnt > 1){
+    // Keep the first page, and the rest for next time.
+    acquire(&fl->lock);
+    give(fl, r->next, tail, cnt - 1);
+    release(&fl->lock);
+  }
+  pop_off();
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Give every hart's cached pages back to the buddy allocator.
+static void
+flush(void)
+{
+  struct run *r, *tail;
+  int cnt;
+
+  for(int id = 0; id < NCPU; id++){
+    acquire(&kcpu[id].lock);
+    r = take(&kcpu[id], kcpu[id].n, &tail, &cnt);
+    release(&kcpu[id].lock);
+    drain(r);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their
+// size. Returns 0 if there is no free block that large.
+void *
+kalloc_order(int order)
+{
+  int i;
+
+  if(order < 0 || order >= NORDER)
+    return 0;
+  if(order == 0)
+    return kalloc();
+
+  acquire(&kmem.lock);
+  i = buddy_alloc(order);
+  release(&kmem.lock);
+  if(i < 0){
+    // The pages cached by the harts may complete a block.
+    flush();
+    acquire(&kmem.lock);
+    i = buddy_alloc(order);
+    release(&kmem.lock);
+    if(i < 0)
+      return 0;
+  }
+  memset(PG2PA(i), 5, PGSIZE << order); // fill with junk
+  return PG2PA(i);
+}
+
+// Free a block allocated by kalloc_order(order).
+void
+kfree_order(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(order < 0 || order >= NORDER || (char*)pa < end || (uint64)pa >= PHYSTOP ||
+     (PA2PG(pa) & ((1L << order) - 1)) != 0 || ((uint64)pa % PGSIZE) != 0)
+    panic("kfree_order");
+
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  buddy_free(PA2PG(pa), order);
+  release(&kmem.lock);
+}
+
+// Fill in st with how much memory is free, and in blocks of
+// which sizes.
+void
+kmemstat(struct memstat *st)
+{
+  st->cached = 0;
+  for(int id = 0; id < NCPU; id++){
+    acquire(&kcpu[id].lock);
+    st->cached += kcpu[id].n;
+    release(&kcpu[id].lock);
+  }
+  acquire(&kmem.lock);
+  st->npage = kmem.npage;
+  st->nfree = kmem.nfree + st->cached;
+  for(int k = 0; k < NORDER; k++)
+    st->nblock[k] = kmem.nblock[k];
+  release(&kmem.lock);
+}
+
+#ifdef MEMTEST
+#define NTEST 16 // blocks of each order to allocate in kmemtest()
+
+// Allocate up to n blocks of 2^order pages, check that each is
+// aligned to its size and keeps what is written at both ends, and
+// free them again, every other one first, so that the rest have to
+// merge with their buddies. The harts' cached pages are given back
+// as well, so that afterwards all free memory is in the buddy
+// allocator, merged as far as it goes. Returns the number of blocks it got,
+// or -1 if one was misaligned or overwritten.
+static int
+testorder(int order, int n)
+{
+  uint64 **blk, *b, last;
+  int i, got, bad = 0;
+
+  if(n > PGSIZE / sizeof(uint64*))
+    n = PGSIZE / sizeof(uint64*);
+  if((blk = kalloc()) == 0)
+    return -1;
+  last = (PGSIZE << order) / sizeof(uint64) - 1;
+  for(got = 0; got < n && (b = kalloc_order(order)) != 0; got++){
+    if((PA2PG(b) & ((1L << order) - 1)) != 0)
+      bad = 1;
+    b[0] = (uint64)b;
+    b[last] = ~(uint64)b;
+    blk[got] = b;
+  }
+  for(i = 0; i < got; i++)
+    if(blk[i][0] != (uint64)blk[i] || blk[i][last] != ~(uint64)blk[i])
+      bad = 1;
+  for(i = 1; i < got; i += 2)
+    kfree_order(blk[i], order);
+  for(i = 0; i < got; i += 2)
+    kfree_order(blk[i], order);
+  kfree(blk);
+  flush();
+  return bad ? -1 : got;
+}
+
+// Test the buddy allocator at boot, in kernels built with
+// make MEMTEST=1: for each order, allocate NTEST blocks of that
+// size, check them and free them again. All the pages must come
+// back, and merge back into blocks at least as large as before.
+void
+kmemtest(void)
+{
+  struct memstat before, after;
+  int k, n;
+
+  for(k = 0; k < NORDER; k++){
+    kmemstat(&before);
+    n = testorder(k, NTEST);
+    kmemstat(&after);
+    if(n <= 0)
+      panic("kmemtest: allocation failed");
+    // Cached pages may have been handed back to make room, so
+    // blocks can end up larger than before, but never smaller.
+    if(after.nfree != before.nfree ||
+       after.nblock[NORDER-1] < before.nblock[NORDER-1])
+      panic("kmemtest: blocks not merged back");
+  }
+  printf("kmemtest: %d orders ok\n", NORDER);
+}
+#endif
@@ -0,0 +1,15 @@
+// Scheduling latency histograms, filled in by getlatstat().
+// Bucket i counts latencies of [2^i, 2^(i+1)) timer cycles,
+// except that bucket 0 also counts 0.
+#define NLATBUCKET 32
+
+struct lathist {
+  uint64 count[NLATBUCKET];
+  uint64 max;               // longest latency seen, in timer cycles
+};
+
+struct latstat {
+  struct lathist wait;   // RUNNABLE until RUNNING
+  struct lathist wakeup; // the same, for processes that had slept
+  struct lathist slice;  // RUNNING until giving up the cpu
+};
@@ -0,0 +1,9 @@
+// Physical memory statistics, filled in by getmemstat().
+#define NORDER 11 // buddy block sizes: 2^0 to 2^10 pages
+
+struct memstat {
+  int npage;          // pages the allocator manages
+  int nfree;          // free pages, including cached ones
+  int cached;         // free pages on the harts' own lists
+  int nblock[NORDER]; // free buddy blocks of each order
+};
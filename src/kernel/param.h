@@ -1,4 +1,4 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      1024  // maximum number of processes, MINSLOTS times a power of two
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -11,3 +11,7 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NSYSCALL     64    // size of the system call count table
+#define NGROUP        8    // lottery ticket groups, including the base one
+#define TICKCYCLES 1000000 // timer cycles per clock tick, about 1/10th second in qemu
+#define BOOST_PERIOD  48   // default ticks between MLFQ priority boosts
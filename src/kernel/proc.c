@@ -5,14 +5,55 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "procstat.h"
+#include "latstat.h"
+#include "slab.h"
 
 int mlll = 0;
 
 #define AGING_THRESHOLD 10
+#define BALANCE_PERIOD 4    // ticks between a cpu's load balancing passes
+#define BALANCE_THRESHOLD 2 // queue length gap that is left alone
+#define MAX_COMPENSATION 10 // most a lottery sleeper's tickets are inflated by
+#define MAX_TICKETS 100000  // most tickets a process draws with
+#define MINSLOTS 64         // process slots to start with, a power of two
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Processes and their latency histograms come from object caches
+// when they are created and go back when they are reaped, and the
+// live ones are on the allproc list. The proc cache is type-stable
+// (see slab.c), and p->lock is initialized once, when the cache
+// carves it: wakeup() and mlfq_balance() find a process under a
+// queue lock and have to drop that before they take p->lock, and
+// by then p may have been reaped and even reused. They can still
+// take the lock safely, and then check that p is still in the
+// state they found it in. Each process also holds a
+// slot while it lives, which gives its kernel stack a place in the
+// kernel page table, its tickets a place in the lottery trees and
+// its pass and timeout room in their heaps. The tables indexed by
+// slot start with room for MINSLOTS and double when every slot is
+// taken, up to NPROC (see grow_slots()). proc_lock protects
+// allproc, the pid hash and the slots; acquire it before p->lock,
+// never after.
+static struct kmem_cache proc_cache;
+static struct kmem_cache latstat_cache;
+static struct proc *allproc;
+static struct proc **slotproc; // Process holding each slot
+static int *freeslots;         // Stack of free slots
+static int nfreeslots;
+static int nslots; // Slots there are; also protected by lottery_lock
+
+// Bumped whenever a kernel stack is mapped or unmapped. A cpu
+// flushes its TLB before it next runs a process, so it cannot use
+// a stale translation of a stack slot that has been reused.
+uint kstack_gen;
+
+// Latency histograms of everything run on each cpu, which
+// getlatstat() sums into the system-wide ones. A process's own
+// are updated by the cpu running it, under p->lock, and a cpu's
+// only by that cpu.
+static struct latstat cpu_latstat[NCPU];
 
 struct proc *initproc;
 
@@ -20,88 +61,944 @@ int nextpid = 1;
 struct spinlock pid_lock;
 struct spinlock proc_lock;
 
+// Every process with a pid hangs off the chain of bucket
+// pid % NPIDHASH, so looking up a pid does not scan or lock the
+// whole table. Pids are handed out in sequence, so consecutive
+// ones land in different buckets. Protected by proc_lock.
+#define NPIDHASH 64
+static struct proc *pidhash[NPIDHASH];
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// The hart p should be queued on: the one it last ran on, if its
+// affinity still allows that, else the first running hart it may
+// use. Caller must hold p->lock.
+static int home_cpu(struct proc *p)
+{
+  if (ALLOWED(p, p->cpu))
+    return p->cpu;
+  for (int i = 0; i < NCPU; i++)
+    if (ALLOWED(p, i) && cpus[i].started)
+      return i;
+  return p->cpu;
+}
+
 // ##########################################################################3333333####################
-struct proc *mlfq[NMLFQ][NPROC];      // Queues for each level of MLFQ
-int queue_size[NMLFQ];                // Number of processes in each queue
+// Every hart owns a set of MLFQ queues with its own lock. Each level
+// is an intrusive FIFO, and bit q of m->nonempty is set while level q
+// holds a process, so enqueue, dequeue, remove and finding the
+// highest non-empty level are all constant time. A hart whose queues
+// are empty steals the best process queued on another hart.
+// Only RUNNABLE processes sit in a queue; a RUNNING process keeps
+// its level in p->queue and is re-queued when it yields.
+// mlfqs[i].lock protects mlfqs[i] and p->qnext, p->qprev and
+// p->inqueue of the processes on it. Acquire it after p->lock,
+// never before, and never hold two of them at once.
+//
+// Every mlfq_boost_period ticks all processes go back to the top
+// level. The clock only bumps mlfq_epoch; nothing is walked then.
+// A hart folds a new epoch into its queues the next time it locks
+// them, by splicing every level onto level 0, and a process not on
+// a queue starts over at level 0 the next time its level is looked
+// at, if p->qepoch is older than the current epoch. A process on a
+// queue may still have a stale p->queue after the splice, so its
+// level on m is qlevel(m, p), not p->queue.
+// A process is charged p->ticks_used[level] for every tick it runs
+// at a level, whether or not it slept in between, and moves down
+// once it has used timeslice[level]; only a boost refills them.
+struct mlfq mlfqs[NCPU];              // MLFQ queues of each CPU
 int timeslice[NMLFQ] = {1, 4, 8, 16}; // Time slices for each level
-#ifdef MLFQ
-static int boost_timer = 0;
-#endif
-// Enqueue process p into queue q
-void enqueue(int q, struct proc *p)
+uint mlfq_epoch;                      // Boosts so far; tickslock
+int mlfq_boost_period = BOOST_PERIOD; // Ticks between boosts; tickslock
+static uint mlfq_boosted;             // Tick of the last boost; tickslock
+
+// Append p to rq.
+// Caller must hold the lock that protects rq.
+static void rq_append(struct runqueue *rq, struct proc *p)
+{
+  p->qnext = 0;
+  p->qprev = rq->tail;
+  if (rq->tail)
+    rq->tail->qnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  rq->size++;
+  p->inqueue = 1;
+}
+
+// Unlink p from rq.
+// Caller must hold the lock that protects rq.
+static void rq_remove(struct runqueue *rq, struct proc *p)
+{
+  if (p->qprev)
+    p->qprev->qnext = p->qnext;
+  else
+    rq->head = p->qnext;
+  if (p->qnext)
+    p->qnext->qprev = p->qprev;
+  else
+    rq->tail = p->qprev;
+  p->qnext = 0;
+  p->qprev = 0;
+  p->inqueue = 0;
+  rq->size--;
+}
+
+// Append all of src to dst, leaving src empty.
+// Caller must hold the lock that protects both.
+static void rq_splice(struct runqueue *dst, struct runqueue *src)
+{
+  if (src->head == 0)
+    return;
+  src->head->qprev = dst->tail;
+  if (dst->tail)
+    dst->tail->qnext = src->head;
+  else
+    dst->head = src->head;
+  dst->tail = src->tail;
+  dst->size += src->size;
+  src->head = src->tail = 0;
+  src->size = 0;
+}
+
+// Start p over at the top level in boost epoch e.
+static void mlfq_reset(struct proc *p, uint e)
+{
+  p->queue = 0;
+  for (int q = 0; q < NMLFQ; q++)
+    p->ticks_used[q] = 0;
+  if (p->pi_queue > 0)
+    p->pi_queue = 0;
+  p->qepoch = e;
+}
+
+// Bump the boost epoch if mlfq_boost_period ticks have passed
+// since the last one. Called by the clock with tickslock held.
+void mlfq_clock(void)
 {
-  if (queue_size[q] < NPROC)
+  if (ticks - mlfq_boosted >= mlfq_boost_period)
   {
-    mlfq[q][queue_size[q]++] = p;
-    p->queue = q; // Update process queue number
+    mlfq_boosted = ticks;
+    mlfq_epoch++;
   }
 }
 
-// Dequeue the process from queue q
-struct proc *dequeue(int q)
+// Set the ticks between boosts.
+int mlfq_setboost(int period)
+{
+  if (period < 1)
+    return -1;
+  acquire(&tickslock);
+  mlfq_boost_period = period;
+  release(&tickslock);
+  return 0;
+}
+
+// Fold any boost since m was last looked at into its queues: the
+// processes on the lower levels go behind those on level 0, in
+// level order, which costs O(NMLFQ) however many are queued.
+// Caller must hold m->lock.
+static void mlfq_sync(struct mlfq *m)
+{
+  uint e = mlfq_epoch;
+
+  if (m->epoch == e)
+    return;
+  for (int q = 1; q < NMLFQ; q++)
+    rq_splice(&m->level[0], &m->level[q]);
+  m->nonempty = m->nproc ? 1 : 0;
+  m->epoch = e;
+}
+
+// The level of p, which is queued on m. A process whose epoch is
+// older than m's was spliced onto level 0 by a boost and is told so
+// here. Caller must hold m->lock, and m must be synced.
+static int qlevel(struct mlfq *m, struct proc *p)
+{
+  if (p->qepoch != m->epoch)
+    mlfq_reset(p, m->epoch);
+  return p->queue;
+}
+
+// The level of p, which is on no queue, after any boost it missed.
+// Caller must hold p->lock.
+static int mlfq_current(struct proc *p)
+{
+  uint e = mlfq_epoch;
+
+  if (p->qepoch != e)
+    mlfq_reset(p, e);
+  return p->queue;
+}
+
+// The level of p, queued or not. Caller must hold p->lock, which
+// keeps p->qcpu and p->inqueue from changing under us. A RUNNING
+// process's level belongs to its own hart, which changes it from
+// the timer interrupt without a lock, so it is only read, and may
+// be a tick out of date.
+static int mlfq_level(struct proc *p)
+{
+  struct mlfq *m = &mlfqs[p->qcpu];
+  int q;
+
+  if (p->state == RUNNING && p != myproc())
+    return p->qepoch == mlfq_epoch ? p->queue : 0;
+  acquire(&m->lock);
+  mlfq_sync(m);
+  q = p->inqueue ? qlevel(m, p) : mlfq_current(p);
+  release(&m->lock);
+  return q;
+}
+
+// Enqueue process p at the tail of queue q of m.
+// Caller must hold m->lock, and m must be synced.
+void enqueue(struct mlfq *m, int q, struct proc *p)
+{
+  if (p->inqueue)
+    return;
+  rq_append(&m->level[q], p);
+  p->qtime = ticks;
+  m->nonempty |= 1 << q;
+  m->nproc++;
+  p->queue = q; // Update process queue number
+  p->qepoch = m->epoch;
+  p->qcpu = m - mlfqs;
+}
+
+// Remove a specific process from the queues of m.
+// Caller must hold m->lock, and m must be synced.
+void remove_from_queue(struct mlfq *m, struct proc *p)
+{
+  struct runqueue *rq;
+  int q;
+
+  if (!p->inqueue || &mlfqs[p->qcpu] != m)
+    return;
+  q = qlevel(m, p);
+  rq = &m->level[q];
+  rq_remove(rq, p);
+  m->nproc--;
+  if (rq->size == 0)
+    m->nonempty &= ~(1 << q);
+}
+
+// Dequeue the process at the head of queue q of m.
+// Caller must hold m->lock, and m must be synced.
+struct proc *dequeue(struct mlfq *m, int q)
 {
-  if (queue_size[q] > 0)
+  struct proc *p = m->level[q].head;
+  if (p)
+    remove_from_queue(m, p);
+  return p;
+}
+
+// Promote every process that has waited AGING_THRESHOLD ticks on
+// its level of m. Each level is a FIFO, so the processes on it are
+// in p->qtime order and only the heads need to be looked at; the
+// cost does not depend on how many processes are waiting.
+// Caller must hold m->lock.
+static void mlfq_age(struct mlfq *m)
+{
+  struct proc *p;
+
+  for (int q = 1; q < NMLFQ; q++)
   {
-    struct proc *p = mlfq[q][0];
-    // Shift all other elements forward
-    for (int i = 1; i < queue_size[q]; i++)
+    while ((p = m->level[q].head) != 0 && ticks - p->qtime >= AGING_THRESHOLD)
     {
-      mlfq[q][i - 1] = mlfq[q][i];
+      remove_from_queue(m, p);
+      enqueue(m, q - 1, p);
     }
-    queue_size[q]--;
-    return p;
   }
-  return 0;
 }
 
-// Remove a specific process from queue q
-void remove_from_queue(int q, struct proc *p)
+// Dequeue the first process that may run on hart id from the
+// highest-priority queue of m that has one, or return 0. Processes
+// are only queued on harts they may run on, so on id's own queues
+// that is always the head of a level.
+static struct proc *mlfq_take(struct mlfq *m, int id)
 {
-  for (int i = 0; i < queue_size[q]; i++)
+  struct proc *p = 0;
+
+  acquire(&m->lock);
+  mlfq_sync(m);
+  mlfq_age(m);
+  for (int q = 0; m->nonempty && q < NMLFQ; q++)
   {
-    if (mlfq[q][i] == p)
+    if (m->nonempty & (1 << q))
     {
-      // Shift all processes forward to fill the gap
-      for (int j = i + 1; j < queue_size[q]; j++)
+      for (p = m->level[q].head; p && !ALLOWED(p, id); p = p->qnext)
+        ;
+      if (p)
       {
-        mlfq[q][j - 1] = mlfq[q][j];
+        remove_from_queue(m, p);
+        break;
       }
-      queue_size[q]--;
-      break;
     }
   }
+  release(&m->lock);
+  return p;
 }
 
-// Promote a process to a higher-priority queue
-void promote(struct proc *p)
+// Choose the next process for cpu c: the best one on its own
+// queues, else one stolen from the first other hart with work.
+static struct proc *mlfq_pick(struct cpu *c)
+{
+  int id = c - cpus;
+  struct proc *p;
+
+  if ((p = mlfq_take(&mlfqs[id], id)) != 0)
+    return p;
+  for (int i = 1; i < NCPU; i++)
+  {
+    struct mlfq *m = &mlfqs[(id + i) % NCPU];
+    // Unlocked peek, so idle harts don't bounce every queue lock.
+    // A stale answer costs one empty locked look or one missed
+    // steal that the next pass retries.
+    if (m->nproc == 0)
+      continue;
+    if ((p = mlfq_take(m, id)) != 0)
+      return p;
+  }
+  return 0;
+}
+
+// Move p to queue level q, keeping its place in the run queues
+// if it is currently queued. Caller must hold p->lock, which keeps
+// p->qcpu from changing under us.
+static void requeue(struct proc *p, int q)
 {
-  int current_queue = p->queue;
-  if (current_queue > 0)
+  struct mlfq *m = &mlfqs[p->qcpu];
+
+  acquire(&m->lock);
+  mlfq_sync(m);
+  if (p->inqueue)
+  {
+    remove_from_queue(m, p);
+    enqueue(m, q, p);
+  }
+  else
   {
-    remove_from_queue(current_queue, p); // Remove from the current queue
-    p->queue--;                          // Move to higher-priority queue
-    enqueue(p->queue, p);                // Enqueue in the new queue
+    mlfq_current(p);
+    p->queue = q;
   }
+  release(&m->lock);
+}
+
+// Promote a process to a higher-priority queue
+void promote(struct proc *p)
+{
+  int q = mlfq_level(p);
+
+  if (q > 0)
+    requeue(p, q - 1);
 }
 
 // Demote a process to a lower-priority queue
 void demote(struct proc *p)
 {
-  int current_queue = p->queue;
-  if (current_queue < NMLFQ - 1)
+  int q = mlfq_level(p);
+
+  if (q < NMLFQ - 1)
+    requeue(p, q + 1);
+}
+
+// Take up a level that inherit_priority() lent p while it was
+// running on its own hart. Called on that hart, from p's tick or
+// when p is queued.
+static void mlfq_borrow(struct proc *p)
+{
+  int q = __sync_lock_test_and_set(&p->pi_lent, -1);
+
+  if (q >= 0 && q < mlfq_current(p))
+  {
+    if (p->pi_queue < 0)
+      p->pi_queue = p->queue;
+    p->queue = q;
+  }
+}
+
+// Queue p on the hart it last ran on, whose caches are warm for
+// it, or on one it may run on if its affinity has changed; idle
+// harts steal it from there if need be. A process new to MLFQ
+// starts at the top. One waking from sleep goes back to the level
+// it left: its allotment there is only refilled by a boost, so
+// sleeping just before the slice runs out buys nothing.
+static void mlfq_enqueue(struct proc *p, int from)
+{
+  struct mlfq *m = &mlfqs[home_cpu(p)];
+
+  if (from == USED)
+    mlfq_reset(p, mlfq_epoch);
+  mlfq_borrow(p);
+  acquire(&m->lock);
+  mlfq_sync(m);
+  enqueue(m, mlfq_current(p), p);
+  release(&m->lock);
+}
+
+static void mlfq_yield(struct proc *p)
+{
+  mlfq_enqueue(p, RUNNING);
+}
+
+static int mlfq_dequeue(struct proc *p)
+{
+  struct mlfq *m = &mlfqs[p->qcpu];
+  int queued;
+
+  acquire(&m->lock);
+  mlfq_sync(m);
+  if ((queued = p->inqueue) != 0)
+    remove_from_queue(m, p);
+  release(&m->lock);
+  return queued;
+}
+
+// Charge p a tick at its level, and demote it once it has used up
+// that level's allotment. p is running, so it is on no queue and
+// its level is ours; other harts only lend it one through
+// p->pi_lent. A level lent by a sleeplock waiter is kept, and not
+// charged for, until p releases its last sleeplock.
+static void mlfq_tick(struct proc *p)
+{
+  int q;
+
+  mlfq_borrow(p);
+  q = mlfq_current(p);
+  if (p->pi_queue >= 0)
+    return;
+
+  if (++p->ticks_used[q] >= timeslice[q] && q < NMLFQ - 1)
+    p->queue++;
+}
+
+// A process on m that hart id may run: the last one on the lowest
+// non-empty level, which is the least likely to run soon where it
+// is. Returns 0 if there is none.
+// Caller must hold m->lock.
+static struct proc *mlfq_victim(struct mlfq *m, int id)
+{
+  struct proc *p;
+
+  for (int q = NMLFQ - 1; q >= 0; q--)
+    for (p = m->level[q].tail; p; p = p->qprev)
+      if (ALLOWED(p, id))
+        return p;
+  return 0;
+}
+
+// Processes stay on the hart they last ran on, and a hart only
+// steals when it has nothing at all to run. To stop queues drifting
+// apart while every hart is busy, each cpu periodically compares its
+// queue with the longest one, and if that is more than
+// BALANCE_THRESHOLD processes longer, pulls half the difference.
+static void mlfq_balance(struct cpu *c)
+{
+  int id = c - cpus, src = -1, n;
+  struct proc *p;
+
+  // Unlocked peeks, as in mlfq_pick(); a wrong guess costs
+  // one pass of moving too little or too much.
+  for (int i = 0; i < NCPU; i++)
+    if (i != id && cpus[i].started &&
+        (src < 0 || mlfqs[i].nproc > mlfqs[src].nproc))
+      src = i;
+  if (src < 0)
+    return;
+  n = mlfqs[src].nproc - mlfqs[id].nproc;
+  if (n <= BALANCE_THRESHOLD)
+    return;
+
+  for (n /= 2; n > 0; n--)
+  {
+    acquire(&mlfqs[src].lock);
+    p = mlfq_victim(&mlfqs[src], id);
+    release(&mlfqs[src].lock);
+    if (p == 0)
+      return;
+
+    // p->lock comes before the queue locks, so take p off src only
+    // now, and only if nobody has picked or moved it meanwhile. p
+    // may even have exited and been reused; the proc cache is
+    // type-stable, so its lock is still there to take.
+    acquire(&p->lock);
+    if (p->state == RUNNABLE && p->sclass == &mlfq_class && p->inqueue &&
+        p->qcpu == src && ALLOWED(p, id))
+    {
+      mlfq_dequeue(p);
+      acquire(&mlfqs[id].lock);
+      mlfq_sync(&mlfqs[id]);
+      enqueue(&mlfqs[id], mlfq_current(p), p);
+      release(&mlfqs[id].lock);
+    }
+    release(&p->lock);
+  }
+}
+
+struct sched_class mlfq_class = {
+    .name = "mlfq",
+    .enqueue = mlfq_enqueue,
+    .dequeue = mlfq_dequeue,
+    .pick_next = mlfq_pick,
+    .tick = mlfq_tick,
+    .yield = mlfq_yield,
+    .balance = mlfq_balance,
+};
+
+// ##########################################################################3333333####################
+// Each hart draws over its own Fenwick trees of the tickets held by
+// the RUNNABLE processes that may run on it, indexed by proc slot,
+// so a draw only ever picks an allowed process. Finding the winner
+// takes O(log nslots), and adding or removing a process
+// O(log nslots) for each hart in its affinity mask. A process enters the trees
+// when it becomes RUNNABLE and leaves them when it wins;
+// p->tree_tickets records what it contributed to each.
+//
+// Tickets come in currencies, as in the lottery scheduling paper.
+// Group 0 is the base currency. Any other group is funded with
+// tg->tickets base tickets, and its members' tickets only divide
+// that funding among them, so a group's share does not grow with
+// the number of processes in it. A draw first picks the base
+// currency's processes by their tickets or a group by its funding,
+// then a member of the group by its tickets, so every hart keeps a
+// tree per group.
+// lottery_lock protects the trees, the groups, p->tree_tickets and
+// p->group. Acquire it after p->lock, never before.
+struct spinlock lottery_lock;
+int *lottery_tree;               // Fenwick trees of tickets, see lottery_of()
+int lottery_total[NCPU][NGROUP]; // Tickets in each tree
+struct tgroup tgroups[NGROUP];
+
+// The Fenwick tree of group g's draw on hart c, in trees of
+// size slots each. It is 1-based, with node j at tree[j - 1].
+static int *lottery_of(int *trees, int size, int c, int g)
+{
+  return trees + (c * NGROUP + g) * size;
+}
+
+// Add n tickets to process slot i in group g's draw on every hart in mask.
+// Caller must hold lottery_lock.
+static void lottery_add(int mask, int g, int i, int n)
+{
+  for (int c = 0; c < NCPU; c++)
+  {
+    if (((mask >> c) & 1) == 0)
+      continue;
+    int *tree = lottery_of(lottery_tree, nslots, c, g);
+    lottery_total[c][g] += n;
+    for (int j = i + 1; j <= nslots; j += j & -j)
+      tree[j - 1] += n;
+  }
+}
+
+// Return the slot whose range of tickets in group g's draw on hart c
+// contains ticket t, for 0 <= t < lottery_total[c][g].
+// Caller must hold lottery_lock.
+static int lottery_find(int c, int g, int t)
+{
+  int *tree = lottery_of(lottery_tree, nslots, c, g);
+  int bit, pos = 0;
+
+  for (bit = nslots; bit > 0; bit /= 2)
+  {
+    if (pos + bit <= nslots && tree[pos + bit - 1] <= t)
+    {
+      pos += bit;
+      t -= tree[pos - 1];
+    }
+  }
+  return pos; // 1-based pos + 1, as a 0-based slot
+}
+
+// The tickets p draws with: its own, or more if a process waiting
+// for one of its sleeplocks lent it some.
+static int lottery_weight(struct proc *p)
+{
+  int n = p->pi_tickets > p->tickets ? p->pi_tickets : p->tickets;
+
+  return n > MAX_TICKETS ? MAX_TICKETS : n;
+}
+
+// Put p's tickets into the draw. A process that blocked after
+// using only a fraction f of its quantum enters with compensation
+// tickets, its tickets inflated by 1/f (up to MAX_COMPENSATION
+// times), until it next wins, so processes that sleep a lot still
+// get their share of the CPU. Either way it draws with at most
+// MAX_TICKETS, which keeps the trees' sums from overflowing.
+// Caller must hold p->lock.
+static void lottery_enqueue(struct proc *p, int from)
+{
+  uint64 w = lottery_weight(p);
+  int n;
+
+  if (from == SLEEPING && p->ran_cycles < TICKCYCLES)
+  {
+    if (p->ran_cycles * MAX_COMPENSATION <= TICKCYCLES)
+      w *= MAX_COMPENSATION;
+    else
+      w = w * TICKCYCLES / p->ran_cycles;
+  }
+  n = w > MAX_TICKETS ? MAX_TICKETS : w;
+  acquire(&lottery_lock);
+  if (p->tree_tickets == 0)
+  {
+    p->tree_tickets = n;
+    lottery_add(p->affinity, p->group, p->slot, p->tree_tickets);
+  }
+  release(&lottery_lock);
+}
+
+static void lottery_yield(struct proc *p)
+{
+  lottery_enqueue(p, RUNNING);
+}
+
+// Take p's tickets out of the draw.
+// Caller must hold p->lock.
+static int lottery_dequeue(struct proc *p)
+{
+  int queued;
+
+  acquire(&lottery_lock);
+  if ((queued = p->tree_tickets != 0) != 0)
+  {
+    lottery_add(p->affinity, p->group, p->slot, -p->tree_tickets);
+    p->tree_tickets = 0;
+  }
+  release(&lottery_lock);
+  return queued;
+}
+
+// Bring p's tickets in the draw, if it is waiting in it, up to
+// date with lottery_weight(p); any compensation it had is dropped.
+// Caller must hold p->lock and lottery_lock.
+static void lottery_reweigh(struct proc *p)
+{
+  int n = lottery_weight(p);
+
+  if (p->tree_tickets != 0)
+  {
+    lottery_add(p->affinity, p->group, p->slot, n - p->tree_tickets);
+    p->tree_tickets = n;
+  }
+}
+
+// Give p n lottery tickets.
+// Caller must hold p->lock and lottery_lock.
+static void lottery_set(struct proc *p, int n)
+{
+  p->tickets = n;
+  lottery_reweigh(p);
+}
+
+// Give p n lottery tickets.
+// Caller must hold p->lock.
+void set_tickets(struct proc *p, int n)
+{
+  acquire(&lottery_lock);
+  lottery_set(p, n);
+  release(&lottery_lock);
+}
+
+// Move n of the calling process's tickets to the process with the
+// given pid, e.g. to lend a server the priority of a client that is
+// blocked on it; the server can give them back the same way. Both
+// must be in the same group, since tickets of different currencies
+// are worth different amounts. Returns -1 if the caller would be
+// left without tickets or there is no such process in its group.
+int transfer_tickets(int pid, int n)
+{
+  struct proc *me = myproc(), *p;
+  int g, done = 0;
+
+  if (n < 1)
+    return -1;
+  acquire(&me->lock);
+  acquire(&lottery_lock);
+  if (me->tickets <= n)
+  {
+    release(&lottery_lock);
+    release(&me->lock);
+    return -1;
+  }
+  lottery_set(me, me->tickets - n);
+  g = me->group;
+  release(&lottery_lock);
+  release(&me->lock);
+
+  // Never hold two p->locks at once: the tickets are out of
+  // circulation in between, and come back if pid is not found.
+  if (pid != me->pid && (p = findproc(pid)) != 0)
+  {
+    if (p->state != ZOMBIE)
+    {
+      acquire(&lottery_lock);
+      if (p->group == g)
+      {
+        lottery_set(p, p->tickets + n);
+        done = 1;
+      }
+      release(&lottery_lock);
+    }
+    release(&p->lock);
+  }
+  if (!done)
+  {
+    acquire(&me->lock);
+    set_tickets(me, me->tickets + n);
+    release(&me->lock);
+    return -1;
+  }
+  return 0;
+}
+
+// Make p a member of group g, leaving its old group, which is
+// freed once its last member leaves. p must not be in the draw.
+// Caller must hold lottery_lock.
+static void join_group(struct proc *p, int g)
+{
+  if (p->group != 0)
+    tgroups[p->group].nproc--;
+  if (g != 0)
+    tgroups[g].nproc++;
+  p->group = g;
+}
+
+// Move the calling process into a new group funded with tickets
+// base tickets. Its children will inherit the group. Returns the
+// group's id, or -1 if all groups are in use.
+int newgroup(int tickets)
+{
+  struct proc *p = myproc();
+
+  if (tickets < 1)
+    return -1;
+  acquire(&lottery_lock);
+  for (int g = 1; g < NGROUP; g++)
   {
-    remove_from_queue(current_queue, p); // Remove from the current queue
-    p->queue++;                          // Move to lower-priority queue
-    enqueue(p->queue, p);                // Enqueue in the new queue
+    if (tgroups[g].nproc == 0)
+    {
+      tgroups[g].tickets = tickets;
+      join_group(p, g);
+      release(&lottery_lock);
+      return g;
+    }
   }
+  release(&lottery_lock);
+  return -1;
 }
 
+// Set the funding of group g. Returns -1 if g is not in use.
+int fundgroup(int g, int tickets)
+{
+  if (g < 1 || g >= NGROUP || tickets < 1)
+    return -1;
+  acquire(&lottery_lock);
+  if (tgroups[g].nproc == 0)
+  {
+    release(&lottery_lock);
+    return -1;
+  }
+  tgroups[g].tickets = tickets;
+  release(&lottery_lock);
+  return 0;
+}
+
+// Per-CPU xorshift generator, so harts never share random state.
+static uint32 random2(struct cpu *c)
+{
+  uint32 x = c->rand_state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  c->rand_state = x;
+  return x;
+}
+
+// Draw a winning ticket in cpu c's draw and take its holder out
+// of the draw, or return 0 if no process may run on c.
+static struct proc *lottery_pick(struct cpu *c)
+{
+  int id = c - cpus, *total = lottery_total[id];
+  int g, t, sum;
+  struct proc *p = 0;
+
+  acquire(&lottery_lock);
+  // Groups with a member waiting here enter with their funding.
+  sum = total[0];
+  for (g = 1; g < NGROUP; g++)
+    if (total[g] > 0)
+      sum += tgroups[g].tickets;
+  if (sum > 0)
+  {
+    t = random2(c) % sum;
+    g = 0;
+    if (t >= total[0])
+    {
+      t -= total[0];
+      for (g = 1; total[g] == 0 || t >= tgroups[g].tickets; g++)
+        if (total[g] > 0)
+          t -= tgroups[g].tickets;
+      t = random2(c) % total[g];
+    }
+    p = slotproc[lottery_find(id, g, t)];
+    lottery_add(p->affinity, g, p->slot, -p->tree_tickets);
+    p->tree_tickets = 0;
+  }
+  release(&lottery_lock);
+  return p;
+}
+
+struct sched_class lottery_class = {
+    .name = "lbs",
+    .enqueue = lottery_enqueue,
+    .dequeue = lottery_dequeue,
+    .pick_next = lottery_pick,
+    .yield = lottery_yield,
+};
+
 // ##########################################################################3333333####################
+// Round robin: one FIFO shared by all harts. Processes run in the
+// order they became RUNNABLE, and a preempted one goes to the back.
+struct
+{
+  struct spinlock lock;
+  struct runqueue queue;
+} rr;
+
+static void rr_enqueue(struct proc *p, int from)
+{
+  acquire(&rr.lock);
+  if (!p->inqueue)
+    rq_append(&rr.queue, p);
+  release(&rr.lock);
+}
+
+static void rr_yield(struct proc *p)
+{
+  rr_enqueue(p, RUNNING);
+}
+
+static int rr_dequeue(struct proc *p)
+{
+  int queued;
+
+  acquire(&rr.lock);
+  if ((queued = p->inqueue) != 0)
+    rq_remove(&rr.queue, p);
+  release(&rr.lock);
+  return queued;
+}
+
+// Take the first queued process that may run on cpu c.
+static struct proc *rr_pick(struct cpu *c)
+{
+  int id = c - cpus;
+  struct proc *p;
+
+  acquire(&rr.lock);
+  for (p = rr.queue.head; p && !ALLOWED(p, id); p = p->qnext)
+    ;
+  if (p)
+    rq_remove(&rr.queue, p);
+  release(&rr.lock);
+  return p;
+}
+
+struct sched_class rr_class = {
+    .name = "rr",
+    .enqueue = rr_enqueue,
+    .dequeue = rr_dequeue,
+    .pick_next = rr_pick,
+    .yield = rr_yield,
+};
+
+// The policy that newly runnable processes are queued by. The
+// SCHEDULER make variable picks the one to boot with, and
+// setscheduler() switches to another on a live system.
+#if defined(MLFQ)
+struct sched_class *sched_class = &mlfq_class;
+#elif defined(LBS)
+struct sched_class *sched_class = &lottery_class;
+#elif defined(STRIDE)
+struct sched_class *sched_class = &stride_class;
+#elif defined(CFS)
+struct sched_class *sched_class = &cfs_class;
+#else
+struct sched_class *sched_class = &rr_class;
+#endif
+
+static struct sched_class *sched_classes[] = {
+    &rr_class, &lottery_class, &mlfq_class, &stride_class, &cfs_class};
+
+// Serializes setscheduler() calls.
+struct spinlock sched_switch_lock;
+
+// ##########################################################################3333333####################
+
+// Sleeping processes wait in a hash table of queues keyed by
+// channel, so wakeup(chan) only looks at processes that hashed
+// to the same bucket instead of the whole table. A queue's lock
+// protects its list and the wnext, wprev and wqueued fields of
+// the processes on it. Acquire it after p->lock, never before.
+#define NWAITQ 64
+
+struct waitq
+{
+  struct spinlock lock;
+  struct proc *head;
+} waitqs[NWAITQ];
+
+static struct waitq *waitq_of(void *chan)
+{
+  return &waitqs[((uint64)chan * 0x9E3779B97F4A7C15ull >> 58) % NWAITQ];
+}
+
+// Link p into the queue of p->chan.
+// Caller must hold p->lock.
+static void waitq_add(struct proc *p)
+{
+  struct waitq *wq = waitq_of(p->chan);
+
+  acquire(&wq->lock);
+  p->wprev = 0;
+  p->wnext = wq->head;
+  if (wq->head)
+    wq->head->wprev = p;
+  wq->head = p;
+  p->wqueued = 1;
+  release(&wq->lock);
+}
+
+// Unlink p from the queue wq. Caller must hold wq->lock.
+static void waitq_unlink(struct waitq *wq, struct proc *p)
+{
+  if (p->wprev)
+    p->wprev->wnext = p->wnext;
+  else
+    wq->head = p->wnext;
+  if (p->wnext)
+    p->wnext->wprev = p->wprev;
+  p->wnext = p->wprev = 0;
+  p->wqueued = 0;
+}
+
+// Take p out of its wait queue, if it is still in one.
+// Caller must hold p->lock.
+static void waitq_remove(struct proc *p)
+{
+  struct waitq *wq = waitq_of(p->chan);
+
+  acquire(&wq->lock);
+  if (p->wqueued)
+    waitq_unlink(wq, p);
+  release(&wq->lock);
+}
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
@@ -109,37 +1006,33 @@ void demote(struct proc *p)
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void proc_mapstacks(pagetable_t kpgtbl)
+// initialize the proc table.
+// Set up a struct proc when the proc cache carves it.
+static void proc_ctor(void *o)
 {
-  struct proc *p;
+  struct proc *p = o;
 
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    char *pa = kalloc();
-    if (pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int)(p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
+  initlock(&p->lock, "proc");
+  p->state = UNUSED;
 }
 
-// initialize the proc table.
 void procinit(void)
 {
-  struct proc *p;
-
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
   initlock(&proc_lock, "proc_lock");
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    initlock(&p->lock, "proc");
-    p->state = UNUSED;
-    p->kstack = KSTACK((int)(p - proc));
-  }
+  for (int i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
+  initlock(&lottery_lock, "lottery");
+  initlock(&rr.lock, "rr");
+  initlock(&sched_switch_lock, "sched_switch");
+  strideinit();
+  cfsinit();
+  edfinit();
+  for (int i = 0; i < NCPU; i++)
+    initlock(&mlfqs[i].lock, "mlfq");
+  kmem_cache_init(&proc_cache, "proc", sizeof(struct proc), proc_ctor);
+  kmem_cache_init(&latstat_cache, "latstat", sizeof(struct latstat), 0);
 }
 
 // Must be called with interrupts disabled,
@@ -182,37 +1075,199 @@ int allocpid()
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
-static struct proc *allocproc(void)
+// Caller must hold proc_lock.
+static void pidhash_add(struct proc *p)
+{
+  struct proc **h = &pidhash[p->pid % NPIDHASH];
+
+  p->hnext = *h;
+  *h = p;
+}
+
+// Caller must hold proc_lock.
+static void pidhash_remove(struct proc *p, int pid)
+{
+  struct proc **pp;
+
+  for (pp = &pidhash[pid % NPIDHASH]; *pp; pp = &(*pp)->hnext)
+  {
+    if (*pp == p)
+    {
+      *pp = p->hnext;
+      break;
+    }
+  }
+}
+
+// Return the process with the given pid, locked, or 0 if there
+// is none. It may be a ZOMBIE.
+struct proc *findproc(int pid)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if (pid <= 0)
+    return 0;
+  acquire(&proc_lock);
+  for (p = pidhash[pid % NPIDHASH]; p && p->pid != pid; p = p->hnext)
+    ;
+  if (p)
   {
+    // freeproc() may have marked p UNUSED, but cannot free it
+    // while proc_lock is held.
     acquire(&p->lock);
     if (p->state == UNUSED)
     {
-      goto found;
+      release(&p->lock);
+      p = 0;
     }
-    else
+  }
+  release(&proc_lock);
+  return p;
+}
+
+// The buddy allocator order of a block of n bytes.
+static int slot_order(uint64 n)
+{
+  int k = 0;
+
+  while ((uint64)PGSIZE << k < n)
+    k++;
+  return k;
+}
+
+// Allocate a zeroed table of n bytes, indexed by slot.
+static void *slot_alloc(uint64 n)
+{
+  void *t;
+
+  if ((t = kalloc_order(slot_order(n))) != 0)
+    memset(t, 0, n);
+  return t;
+}
+
+static void slot_free(void *t, uint64 n)
+{
+  if (t)
+    kfree_order(t, slot_order(n));
+}
+
+// Double the number of slots, or make the first MINSLOTS: move
+// the slot tables, the lottery trees and the stride and timeout
+// heaps into tables with room for twice as many and free the old
+// ones. Returns -1 if there are NPROC slots already or memory
+// ran out. The tables never shrink, so they take memory for the
+// most processes there have been at once rather than for NPROC.
+// Caller must hold proc_lock.
+static int grow_slots(void)
+{
+  int n = nslots > 0 ? 2 * nslots : MINSLOTS, old = nslots;
+  uint64 ntree = NCPU * NGROUP * sizeof(int);
+  struct proc **sp = 0, **sh = 0, **th = 0, **oldsp;
+  int *fs = 0, *trees = 0, *oldtrees;
+
+  if (n > NPROC)
+    return -1;
+  if ((sp = slot_alloc(n * sizeof(sp[0]))) == 0 ||
+      (fs = slot_alloc(n * sizeof(fs[0]))) == 0 ||
+      (trees = slot_alloc(n * ntree)) == 0 ||
+      (sh = slot_alloc(n * sizeof(sh[0]))) == 0 ||
+      (th = slot_alloc(n * sizeof(th[0]))) == 0)
+  {
+    slot_free(sp, n * sizeof(sp[0]));
+    slot_free(fs, n * sizeof(fs[0]));
+    slot_free(trees, n * ntree);
+    slot_free(sh, n * sizeof(sh[0]));
+    return -1;
+  }
+  memmove(fs, freeslots, nfreeslots * sizeof(fs[0]));
+  for (int i = n - 1; i >= old; i--)
+    fs[nfreeslots++] = i;
+  slot_free(freeslots, old * sizeof(fs[0]));
+  freeslots = fs;
+
+  acquire(&lottery_lock);
+  memmove(sp, slotproc, old * sizeof(sp[0]));
+  // A node of a tree twice the size covers the same slots as in
+  // the old one, or only new, empty ones, or all of them.
+  for (int c = 0; c < NCPU; c++)
+  {
+    for (int g = 0; g < NGROUP; g++)
     {
-      release(&p->lock);
+      int *to = lottery_of(trees, n, c, g);
+
+      if (old > 0)
+        memmove(to, lottery_of(lottery_tree, old, c, g), old * sizeof(int));
+      to[n - 1] = lottery_total[c][g];
     }
   }
+  oldtrees = lottery_tree;
+  lottery_tree = trees;
+  oldsp = slotproc;
+  slotproc = sp;
+  nslots = n;
+  release(&lottery_lock);
+
+  slot_free(oldtrees, old * ntree);
+  slot_free(oldsp, old * sizeof(sp[0]));
+  slot_free(stride_resize(sh), old * sizeof(sh[0]));
+  slot_free(timeout_resize(th), old * sizeof(th[0]));
   return 0;
+}
 
-found:
+// Allocate a proc, its latency histograms and its kernel stack,
+// give it a slot and map the stack there, initialize state
+// required to run in the kernel, and return with p->lock held.
+// If all slots are taken, or a memory allocation fails, return 0.
+static struct proc *allocproc(void)
+{
+  struct proc *p;
+  struct latstat *lat = 0;
+  char *kstack = 0;
+  int slot;
+
+  if ((p = kmem_cache_alloc(&proc_cache)) == 0 ||
+      (lat = kmem_cache_alloc(&latstat_cache)) == 0 ||
+      (kstack = kalloc()) == 0)
+    goto bad;
+  // Someone holding a stale pointer may hold p->lock, so leave
+  // it alone; p->state is already UNUSED, which they check.
+  memset((char *)p + sizeof(p->lock), 0, sizeof(*p) - sizeof(p->lock));
+  p->lat = lat;
+
+  acquire(&proc_lock);
+  if (nfreeslots == 0 && grow_slots() < 0)
+  {
+    release(&proc_lock);
+    goto bad;
+  }
+  slot = freeslots[--nfreeslots];
+  if (kvmmappage(KSTACK(slot), (uint64)kstack) < 0)
+  {
+    freeslots[nfreeslots++] = slot;
+    release(&proc_lock);
+    goto bad;
+  }
+  kstack_gen++;
+  p->slot = slot;
+  p->kstack = KSTACK(slot);
+  slotproc[slot] = p;
+  p->allnext = allproc;
+  if (allproc)
+    allproc->allprev = p;
+  allproc = p;
   p->pid = allocpid();
+  pidhash_add(p);
   p->state = USED;
+  acquire(&p->lock);
+  release(&proc_lock);
+
+  p->children = p->zombies = 0;
+  p->nzombies = 0;
 
   // Allocate a trapframe page.
   if ((p->trapframe = (struct trapframe *)kalloc()) == 0)
   {
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
@@ -220,45 +1275,199 @@ found:
   p->pagetable = proc_pagetable(p);
   if (p->pagetable == 0)
   {
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+    freeproc(p);
+    return 0;
+  }
+
+  // Set up new context to start executing at forkret,
+  // which returns to user space.
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)forkret;
+  p->context.sp = p->kstack + PGSIZE;
+  p->rtime = 0;
+  p->etime = 0;
+  p->ctime = ticks;
+  p->flagg = 0;
+  p->alarm_called = 0;
+  p->rt_runtime = 0;
+  p->timeout_index = -1;
+  p->sclass = 0;
+  p->cpu = 0;
+  p->affinity = AFFINITY_ALL;
+  p->migrations = 0;
+  p->quota = 0;
+  p->period = 0;
+  p->quota_used = 0;
+  p->throttled = 0;
+  memset(p->lat, 0, sizeof(struct latstat));
+  p->nsleeplocks = 0;
+  p->pi_queue = -1;
+  p->pi_lent = -1;
+  p->pi_tickets = 0;
+  p->ran_cycles = 0;
+  p->arrival_time = ticks;
+
+  // MLFQ
+  mlfq_reset(p, mlfq_epoch);
+  p->qtime = 0;
+  p->qnext = 0;
+  p->qprev = 0;
+  p->inqueue = 0;
+
+  // LBS, STRIDE and CFS
+  p->tickets = 1;
+  p->tree_tickets = 0;
+  p->pass = 0;
+  p->heap_index = -1;
+  p->vruntime = 0;
+  p->rbqueued = 0;
+
+  return p;
+
+bad:
+  if (kstack)
+    kfree(kstack);
+  if (lat)
+    kmem_cache_free(&latstat_cache, lat);
+  if (p)
+    kmem_cache_free(&proc_cache, p);
+  return 0;
+}
+
+// Bumped every time a process is made RUNNABLE, so a cpu about to
+// go idle can tell whether work appeared since it last looked.
+uint runnable_seq;
+
+// Send hart id an IPI. It arrives as a supervisor software
+// interrupt, via timervec in kernelvec.S.
+static void send_ipi(int id)
+{
+  *(volatile uint32 *)CLINT_MSIP(id) = 1;
+}
+
+// A process has become RUNNABLE: wake an idle cpu that may run
+// it, preferring the one p last ran on. Each idle cpu is claimed
+// by clearing its flag, so one wakeup never lands twice.
+static void kick(struct proc *p)
+{
+  __sync_fetch_and_add(&runnable_seq, 1);
+  if (ALLOWED(p, p->cpu) &&
+      __sync_bool_compare_and_swap(&cpus[p->cpu].idle, 1, 0))
+  {
+    send_ipi(p->cpu);
+    return;
+  }
+  for (int i = 0; i < NCPU; i++)
+  {
+    if (ALLOWED(p, i) && __sync_bool_compare_and_swap(&cpus[i].idle, 1, 0))
+    {
+      send_ipi(i);
+      return;
+    }
+  }
+}
+
+// Nothing was runnable when this cpu last looked, at runnable_seq
+// seq. Unless something has become runnable since, wait in wfi for
+// an interrupt: the next tick, a device, or an IPI from kick().
+// A kick() that races with us either bumps runnable_seq before we
+// check it, or sees our idle flag and sends an IPI, which makes
+// wfi return at once even though interrupts are off.
+static void idle(struct cpu *c, uint seq)
+{
+  uint64 start;
+
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
+  if (runnable_seq == seq)
+  {
+    start = r_time();
+    asm volatile("wfi");
+    c->idle_cycles += r_time() - start;
+  }
+  c->idle = 0;
+  intr_on();
+}
+
+// Mark p RUNNABLE and hand it to the run queue of the
+// scheduling policy.
+// p->lock must be held.
+static void make_runnable(struct proc *p)
+{
+  // A process that yields is already on a cpu, which is about
+  // to pick again; anything else is new work for an idle cpu.
+  int wake = p->state != RUNNING;
+  struct sched_class *cl = sched_class;
+
+  p->runnable_at = r_time();
+  p->woken = p->state == SLEEPING;
+  if (p->rt_runtime > 0)
+  {
+    // Real-time processes belong to EDF, not to the policy.
+    p->state = RUNNABLE;
+    edf_enter(p);
+    if (wake)
+      kick(p);
+    return;
   }
+  // A process that the policy has not seen before, because it
+  // is new or the policy was switched, joins it as a new one.
+  if (p->sclass != cl)
+    cl->enqueue(p, USED);
+  else if (p->state == RUNNING)
+    cl->yield(p);
+  else
+    cl->enqueue(p, p->state);
+  p->sclass = cl;
+  p->state = RUNNABLE;
+  if (wake)
+    kick(p);
+}
 
-  // Set up new context to start executing at forkret,
-  // which returns to user space.
-  memset(&p->context, 0, sizeof(p->context));
-  p->context.ra = (uint64)forkret;
-  p->context.sp = p->kstack + PGSIZE;
-  p->rtime = 0;
-  p->etime = 0;
-  p->ctime = ticks;
-  p->flagg = 0;
-  p->alarm_called = 0;
-#ifdef MLFQ
-  p->queue = 0;
-  p->time_in_current_queue = 0;
-  p->arrival_time = ticks;
-  p->ticks_used[0] = 0;
-  p->ticks_used[1] = 0;
-  p->ticks_used[2] = 0;
-  p->ticks_used[3] = 0;
-#endif
+// Switch the scheduling policy to the class called name, moving
+// every queued process over to it. A process that is running, or
+// that another cpu has just picked, moves when it next becomes
+// RUNNABLE. Returns 0, or -1 if there is no such class.
+int setscheduler(char *name)
+{
+  struct sched_class *cl = 0;
+  struct proc *p;
 
-#ifdef LBS
-  // printf("99\n");
-  p->tickets = 1;
-  p->arrival_time = ticks;
-#endif
+  for (int i = 0; i < NELEM(sched_classes); i++)
+    if (strncmp(name, sched_classes[i]->name, 16) == 0)
+      cl = sched_classes[i];
+  if (cl == 0)
+    return -1;
 
-  return p;
+  acquire(&sched_switch_lock);
+  sched_class = cl;
+  __sync_synchronize();
+  acquire(&proc_lock);
+  for (p = allproc; p; p = p->allnext)
+  {
+    acquire(&p->lock);
+    if (p->state == RUNNABLE && p->rt_runtime == 0 && p->sclass != cl &&
+        p->sclass->dequeue(p))
+    {
+      p->sclass = cl;
+      cl->enqueue(p, USED);
+      kick(p);
+    }
+    release(&p->lock);
+  }
+  release(&proc_lock);
+  release(&sched_switch_lock);
+  return 0;
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages and its kernel stack.
+// p->lock must be held, and is released.
 static void freeproc(struct proc *p)
 {
+  int pid = p->pid;
+
   if (p->trapframe)
     kfree((void *)p->trapframe);
   p->trapframe = 0;
@@ -272,7 +1481,28 @@ static void freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  acquire(&lottery_lock);
+  join_group(p, 0);
+  release(&lottery_lock);
   p->state = UNUSED;
+  release(&p->lock);
+
+  acquire(&proc_lock);
+  if (p->allprev)
+    p->allprev->allnext = p->allnext;
+  else
+    allproc = p->allnext;
+  if (p->allnext)
+    p->allnext->allprev = p->allprev;
+  pidhash_remove(p, pid);
+  slotproc[p->slot] = 0;
+  kvmunmappage(p->kstack);
+  kstack_gen++;
+  freeslots[nfreeslots++] = p->slot;
+  release(&proc_lock);
+
+  kmem_cache_free(&latstat_cache, p->lat);
+  kmem_cache_free(&proc_cache, p);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -349,7 +1579,7 @@ void userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  make_runnable(p);
 
   release(&p->lock);
 }
@@ -377,6 +1607,30 @@ int growproc(int n)
   return 0;
 }
 
+// A parent's live children and its zombie children are kept on
+// two lists, so wait() finds an exited child without looking at
+// the rest, and reparent() only touches the exiting process's own
+// children. Caller must hold wait_lock.
+static void child_link(struct proc **list, struct proc *p)
+{
+  p->sibprev = 0;
+  p->sibnext = *list;
+  if (*list)
+    (*list)->sibprev = p;
+  *list = p;
+}
+
+static void child_unlink(struct proc **list, struct proc *p)
+{
+  if (p->sibprev)
+    p->sibprev->sibnext = p->sibnext;
+  else
+    *list = p->sibnext;
+  if (p->sibnext)
+    p->sibnext->sibprev = p->sibprev;
+  p->sibnext = p->sibprev = 0;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int fork(void)
@@ -395,7 +1649,6 @@ int fork(void)
   if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0)
   {
     freeproc(np);
-    release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
@@ -413,6 +1666,14 @@ int fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->cpu = p->cpu; // start out on the parent's hart
+  np->affinity = p->affinity;
+  np->quota = p->quota; // with a budget of its own
+  np->period = p->period;
+  np->period_start = ticks;
+  acquire(&lottery_lock);
+  join_group(np, p->group);
+  release(&lottery_lock);
 
   pid = np->pid;
 
@@ -420,29 +1681,111 @@ int fork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  child_link(&p->children, np);
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  make_runnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Restrict the process with the given pid to the harts in mask.
+// A queued process moves to a run queue it may be picked from, and
+// the caller gives up a hart it may no longer use. Returns -1 if
+// there is no such process or mask allows no running hart.
+int setaffinity(int pid, int mask)
+{
+  struct proc *p;
+  int i;
+
+  for (i = 0; i < NCPU; i++)
+    if (((mask >> i) & 1) && cpus[i].started)
+      break;
+  if (i == NCPU || (mask & ~AFFINITY_ALL) != 0)
+    return -1;
+
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  if (p->state == RUNNABLE && p->rt_runtime == 0 && p->sclass->dequeue(p))
+  {
+    p->affinity = mask;
+    p->sclass->enqueue(p, RUNNABLE);
+    kick(p);
+  }
+  else
+  {
+    p->affinity = mask;
+  }
+  release(&p->lock);
+  if (p == myproc())
+  {
+    push_off();
+    i = cpuid();
+    pop_off();
+    if (((mask >> i) & 1) == 0)
+      yield();
+  }
+  return 0;
+}
+
+// Return the affinity mask of the process with the given pid,
+// or -1 if there is none.
+int getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->affinity;
+  release(&p->lock);
+  return mask;
+}
+
+// Fill in *st for the process with the given pid.
+// Returns -1 if there is no such process.
+int getprocstat(int pid, struct procstat *st)
+{
+  struct proc *p;
+
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  st->pid = p->pid;
+  st->cpu = p->cpu;
+  st->migrations = p->migrations;
+  st->rtime = p->rtime;
+  st->tickets = p->tickets;
+  st->throttled = p->throttled;
+  st->level = mlfq_level(p);
+  release(&p->lock);
+  return 0;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for (pp = proc; pp < &proc[NPROC]; pp++)
+  if (p->children == 0 && p->zombies == 0)
+    return;
+  while ((pp = p->children) != 0)
   {
-    if (pp->parent == p)
-    {
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+    child_unlink(&p->children, pp);
+    pp->parent = initproc;
+    child_link(&initproc->children, pp);
+  }
+  while ((pp = p->zombies) != 0)
+  {
+    child_unlink(&p->zombies, pp);
+    pp->parent = initproc;
+    child_link(&initproc->zombies, pp);
+    initproc->nzombies++;
   }
+  p->nzombies = 0;
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -476,11 +1819,16 @@ void exit(int status)
   // Give any children to init.
   reparent(p);
 
+  child_unlink(&p->parent->children, p);
+  child_link(&p->parent->zombies, p);
+  p->parent->nzombies++;
+
   // Parent might be sleeping in wait().
   wakeup(p->parent);
 
   acquire(&p->lock);
 
+  edf_exit(p);
   p->xstate = status;
   p->state = ZOMBIE;
   p->etime = ticks;
@@ -497,45 +1845,35 @@ void exit(int status)
 int wait(uint64 addr)
 {
   struct proc *pp;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for (;;)
   {
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for (pp = proc; pp < &proc[NPROC]; pp++)
+    if ((pp = p->zombies) != 0)
     {
-      if (pp->parent == p)
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      pid = pp->pid;
+      if (addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                               sizeof(pp->xstate)) < 0)
       {
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if (pp->state == ZOMBIE)
-        {
-          // Found one.
-          pid = pp->pid;
-          if (addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                   sizeof(pp->xstate)) < 0)
-          {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
         release(&pp->lock);
+        release(&wait_lock);
+        return -1;
       }
+      child_unlink(&p->zombies, pp);
+      p->nzombies--;
+      freeproc(pp);
+      release(&wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if (!havekids || killed(p))
+    if (p->children == 0 || killed(p))
     {
       release(&wait_lock);
       return -1;
@@ -554,181 +1892,196 @@ int wait(uint64 addr)
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
 
-uint32 random_state = 1;
+// Charge one scheduling decision, begun at timer value start,
+// to this cpu's pick counters.
+static void account_pick(struct cpu *c, uint64 start)
+{
+  c->picks++;
+  c->pick_cycles += r_time() - start;
+}
+
+// Count a latency of v timer cycles in h.
+static void lat_add(struct lathist *h, uint64 v)
+{
+  int i = 0;
+
+  while (i < NLATBUCKET - 1 && (v >> (i + 1)) != 0)
+    i++;
+  h->count[i]++;
+  if (v > h->max)
+    h->max = v;
+}
+
+// Make p, which must be locked and RUNNABLE, c's running process,
+// just before switching to it.
+static void switch_in(struct cpu *c, struct proc *p)
+{
+  int id = c - cpus;
+  uint64 start;
+  struct latstat *pl = p->lat, *cl = &cpu_latstat[id];
+
+  // A new process counts as last run on its parent's hart.
+  if (p->cpu != id)
+  {
+    p->migrations++;
+    c->migrations++;
+  }
+  p->state = RUNNING;
+  p->cpu = id;
+  c->proc = p;
+  if (c->kstack_gen != kstack_gen)
+  {
+    c->kstack_gen = kstack_gen;
+    sfence_vma();
+  }
+  start = r_time();
+  lat_add(&pl->wait, start - p->runnable_at);
+  lat_add(&cl->wait, start - p->runnable_at);
+  if (p->woken)
+  {
+    lat_add(&pl->wakeup, start - p->runnable_at);
+    lat_add(&cl->wakeup, start - p->runnable_at);
+  }
+  c->run_start = start;
+}
+
+// p, c's running process, is done running for now.
+static void switch_out(struct cpu *c, struct proc *p)
+{
+  p->ran_cycles = r_time() - c->run_start;
+  lat_add(&p->lat->slice, p->ran_cycles);
+  lat_add(&cpu_latstat[c - cpus].slice, p->ran_cycles);
+}
 
-uint32 random2()
+// Switch to p, which must be locked and RUNNABLE. It is the
+// process's job to release its lock and then reacquire it before
+// jumping back to us. The process that jumps back may not be p,
+// if sched() switched from p straight to another one; it is
+// returned, locked.
+static struct proc *run(struct cpu *c, struct proc *p)
 {
+  switch_in(c, p);
+  swtch(&c->context, &p->context);
+
+  // Process is done running for now.
+  // It should have changed its p->state before coming back.
+  p = c->proc;
+  switch_out(c, p);
+  c->proc = 0;
+  return p;
+}
 
-  random_state = (random_state * 1103515245 + 12345) % 2147483648;
+// Lock p, which a policy or EDF has just picked, and return 1 if
+// it is still RUNNABLE. Only they hand out RUNNABLE processes, so
+// nobody else can have started p since. If setaffinity() took this
+// cpu away from p after it was picked, queue it again instead.
+static int claim(struct cpu *c, struct proc *p, uint64 start)
+{
+  account_pick(c, start);
+  acquire(&p->lock);
+  if (p->state == RUNNABLE && ALLOWED(p, c - cpus))
+    return 1;
+  if (p->state == RUNNABLE)
+  {
+    if (p->rt_runtime > 0)
+      edf_enter(p);
+    else
+      p->sclass->enqueue(p, RUNNABLE);
+    kick(p);
+  }
+  release(&p->lock);
+  return 0;
+}
 
-  return random_state;
+static void run_picked(struct cpu *c, struct proc *p, uint64 start)
+{
+  if (claim(c, p, start))
+    release(&run(c, p)->lock);
 }
+
 void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  uint64 start;
+  uint seq;
 
   c->proc = 0;
+  c->rand_state = (r_time() ^ (cpuid() + 1) * 2654435761u) | 1;
+  c->started = 1;
   for (;;)
   {
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-#ifdef MLFQ
+    start = r_time();
+    seq = runnable_seq;
 
-    for (int q = 0; q < NMLFQ; q++)
-    {
-      for (int i = 0; i < queue_size[q]; i++)
-      {
-        p = mlfq[q][i];
-
-        acquire(&p->lock);
-
-        if (p->state == RUNNABLE)
-        {
-          // If process is ready to run, handle it
-          p->state = RUNNING;
-          c->proc = p;
-          swtch(&c->context, &p->context);
-          c->proc = 0;
-
-          // Handle time slice expiration and demotion
-          p->ticks_used[p->queue]++;
-          boost_timer++;
-
-          // if (boost_timer % 48 == 0)
-          // {
-          //   // Move all processes to queue 0
-          //   for (int j = 0; j < NMLFQ; j++)
-          //   {
-          //     while (queue_size[j] > 0)
-          //     {
-          //       struct proc *to_boost = dequeue(j); // Dequeue from current queue
-          //       remove_from_queue(j, to_boost);     // Ensure it's removed from the old queue
-          //       enqueue(0, to_boost);               // Enqueue to queue 0
-          //     }
-          //   }
-          // }
-
-          if (p->ticks_used[p->queue] >= timeslice[p->queue])
-          {
-            p->ticks_used[p->queue] = 0; // Reset ticks
-            demote(p);
-          }
-        }
-        else if (p->state == SLEEPING)
-        {
-          // Handle aging: increase wait time
-          p->wait_time++;
-
-          // If wait time exceeds the aging threshold, promote the process
-          if (p->wait_time >= AGING_THRESHOLD)
-          {
-            p->wait_time = 0; // Reset wait time after promotion
-            promote(p);
-          }
-        }
-
-        release(&p->lock);
-      }
-    }
-#endif
-#ifdef LBS
-    int total_tickets = 0;
-    int winning_ticket;
-    int current_ticket = 0;
-    struct proc *selected_proc = 0;
-    uint64 min_arrival_time = __INT64_MAX__; // Use a large number to track the minimum arrival time.
-
-    // Count total tickets for runnable processes.
-    for (p = proc; p < &proc[NPROC]; p++)
+    if (sched_class->balance && ticks - c->balanced >= BALANCE_PERIOD)
     {
-      if (p->state == ZOMBIE || p->state == UNUSED || p->killed)
-      {
-        continue;
-      }
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        total_tickets += p->tickets;
-      }
-      release(&p->lock);
+      c->balanced = ticks;
+      sched_class->balance(c);
     }
-    // printf("total = %d\n",total_tickets);
-    // If no runnable processes, continue to next iteration.
-    if (total_tickets == 0)
+
+    // Real-time processes always go ahead of the policy.
+    if ((p = edf_pick(c)) != 0)
     {
+      run_picked(c, p, start);
       continue;
     }
-    // printf("total\n");
-    // Randomly choose a winning ticket.
-    winning_ticket = (uint64)random2() % total_tickets;
-    // printf("win = %d\n",winning_ticket);
 
-    // Select the process corresponding to the winning ticket.
-    for (p = proc; p < &proc[NPROC]; p++)
-    {
+    if ((p = sched_class->pick_next(c)) != 0)
+      run_picked(c, p, start);
+    else
+      idle(c, seq);
+  }
+}
 
-      if (p->state == ZOMBIE || p->state == UNUSED || p->killed)
-      {
-        selected_proc = 0;
-        continue;
-      }
+// May sched() switch straight to the next process? Only turned
+// off to measure what that saves; see setdirect().
+static int direct_switch = 1;
 
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        // printf("total\n");
-        if (current_ticket <= winning_ticket && winning_ticket < current_ticket + p->tickets)
-        {
-          if (selected_proc == 0 || p->arrival_time < min_arrival_time)
-          {
-            selected_proc = p;
-            min_arrival_time = p->arrival_time;
-          }
-        }
-        current_ticket += p->tickets;
-      }
-      release(&p->lock);
-    }
+// Turn direct switches in sched() on (1) or off (0), or leave them
+// be (-1). Returns the setting before.
+int setdirect(int on)
+{
+  int old = direct_switch;
 
-    if (selected_proc)
-    {
-      // Switch to the selected process.
-      selected_proc->state = RUNNING;
-      c->proc = selected_proc;
-      swtch(&c->context, &selected_proc->context);
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
-      release(&selected_proc->lock);
-    }
+  if (on >= 0)
+    direct_switch = on != 0;
+  return old;
+}
 
-#endif
-    for (p = proc; p < &proc[NPROC]; p++)
-    {
+// Pick the process that should run next on c, the way scheduler()
+// would, and return it locked, or 0 if there is none. Called by a
+// process giving up c that is not RUNNABLE, and so cannot be
+// picked, locked or run by anyone else meanwhile: holding its
+// lock while taking the next one's cannot deadlock.
+static struct proc *pick_direct(struct cpu *c)
+{
+  uint64 start = r_time();
+  struct proc *p;
 
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        // printf("ddd\n");
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
-    }
+  if ((p = edf_pick(c)) == 0 && (p = sched_class->pick_next(c)) == 0)
+    return 0;
+  return claim(c, p, start) ? p : 0;
+}
+
+// A process has just been switched to. If the switch came straight
+// from another process in sched(), release that one's lock.
+static void finish_switch(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev = c->prev;
+
+  if (prev)
+  {
+    c->prev = 0;
+    release(&prev->lock);
   }
 }
 
-// Switch to scheduler.  Must hold only p->lock
+// Switch to scheduler, or directly to the next process.
+// Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -738,7 +2091,7 @@ void scheduler(void)
 void sched(void)
 {
   int intena;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *np;
 
   if (!holding(&p->lock))
     panic("sched p->lock");
@@ -750,8 +2103,24 @@ void sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
-  swtch(&p->context, &mycpu()->context);
+  if (p->state != RUNNABLE && direct_switch && (np = pick_direct(mycpu())) != 0)
+  {
+    // Go straight to the next process rather than through this
+    // cpu's scheduler thread, which would take a second switch.
+    // np releases p->lock once it is running, as scheduler()
+    // would have.
+    mycpu()->prev = p;
+    mycpu()->direct++;
+    switch_out(mycpu(), p);
+    switch_in(mycpu(), np);
+    swtch(&p->context, &np->context);
+  }
+  else
+  {
+    swtch(&p->context, &mycpu()->context);
+  }
   mycpu()->intena = intena;
+  finish_switch();
 }
 
 // Give up the CPU for one scheduling round.
@@ -759,7 +2128,7 @@ void yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  make_runnable(p);
   sched();
   release(&p->lock);
 }
@@ -770,7 +2139,9 @@ void forkret(void)
 {
   static int first = 1;
 
-  // Still holding p->lock from scheduler.
+  // Still holding p->lock from scheduler, or from sched() in
+  // the process we were switched to from.
+  finish_switch();
   release(&myproc()->lock);
 
   if (first)
@@ -793,16 +2164,17 @@ void sleep(void *chan, struct spinlock *lk)
 
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // wakeup() only looks for sleepers in chan's wait queue, so p
+  // must be on it before lk is released: a waker holding lk then
+  // either finds p there, and waits on p->lock until p is asleep,
+  // or ran before p took lk in the first place.
 
   acquire(&p->lock); // DOC: sleeplock1
+  p->chan = chan;
+  waitq_add(p);
   release(lk);
 
   // Go to sleep.
-  p->chan = chan;
   p->state = SLEEPING;
 
   sched();
@@ -819,22 +2191,35 @@ void sleep(void *chan, struct spinlock *lk)
 // Must be called without any p->lock.
 void wakeup(void *chan)
 {
+  struct waitq *wq = waitq_of(chan);
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (;;)
   {
-    if (p != myproc())
+    // Unlink one sleeper on chan. Its p->lock has to be taken
+    // without wq->lock held, so go one process at a time.
+    acquire(&wq->lock);
+    for (p = wq->head; p && p->chan != chan; p = p->wnext)
+      ;
+    if (p)
+      waitq_unlink(wq, p);
+    release(&wq->lock);
+    if (p == 0)
+      return;
+
+    // p may have been woken by kill() meanwhile, and even gone
+    // back to sleep; then it must leave the queue again. It may
+    // also have exited and been reaped, but the proc cache is
+    // type-stable, so p->lock is still a lock, and p is then no
+    // longer SLEEPING on chan, or is a new process that is, which
+    // only gets a spurious wakeup.
+    acquire(&p->lock);
+    if (p->state == SLEEPING && p->chan == chan)
     {
-      acquire(&p->lock);
-      if (p->state == SLEEPING && p->chan == chan)
-      {
-        p->state = RUNNABLE;
-#ifdef MLFQ
-        promote(p);
-#endif
-      }
-      release(&p->lock);
+      waitq_remove(p);
+      make_runnable(p);
     }
+    release(&p->lock);
   }
 }
 
@@ -845,23 +2230,17 @@ int kill(int pid)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if (p->state == SLEEPING)
   {
-    acquire(&p->lock);
-    if (p->pid == pid)
-    {
-      p->killed = 1;
-      if (p->state == SLEEPING)
-      {
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+    // Wake process from sleep().
+    waitq_remove(p);
+    make_runnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void setkilled(struct proc *p)
@@ -926,7 +2305,8 @@ void procdump(void)
   char *state;
 
   printf("\n");
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&proc_lock);
+  for (p = allproc; p; p = p->allnext)
   {
     if (p->state == UNUSED)
       continue;
@@ -937,53 +2317,44 @@ void procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
+  release(&proc_lock);
 }
 
 // waitx
 int waitx(uint64 addr, uint *wtime, uint *rtime)
 {
   struct proc *np;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for (;;)
   {
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for (np = proc; np < &proc[NPROC]; np++)
+    if ((np = p->zombies) != 0)
     {
-      if (np->parent == p)
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      pid = np->pid;
+      *rtime = np->rtime;
+      *wtime = np->etime - np->ctime - np->rtime;
+      if (addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                               sizeof(np->xstate)) < 0)
       {
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if (np->state == ZOMBIE)
-        {
-          // Found one.
-          pid = np->pid;
-          *rtime = np->rtime;
-          *wtime = np->etime - np->ctime - np->rtime;
-          if (addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                   sizeof(np->xstate)) < 0)
-          {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
         release(&np->lock);
+        release(&wait_lock);
+        return -1;
       }
+      child_unlink(&p->zombies, np);
+      p->nzombies--;
+      freeproc(np);
+      release(&wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if (!havekids || p->killed)
+    if (p->children == 0 || p->killed)
     {
       release(&wait_lock);
       return -1;
@@ -994,61 +2365,185 @@ int waitx(uint64 addr, uint *wtime, uint *rtime)
   }
 }
 
+// Charge the clock tick that just interrupted this cpu to the
+// process running on it. Nothing but this cpu changes the run time
+// and policy accounting of its running process, and interrupts are
+// off, so no lock is taken and the cost of a tick does not grow
+// with NPROC.
 void update_time(void)
 {
-  struct proc *p;
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
+  struct proc *p = myproc();
 
-    acquire(&p->lock);
-    if (p->state == RUNNING)
+  if (p == 0 || p->state != RUNNING)
+    return;
+  p->rtime++;
+  if (p->quota > 0)
+  {
+    if (ticks - p->period_start >= p->period)
     {
-      p->rtime++;
+      p->period_start = ticks - (ticks - p->period_start) % p->period;
+      p->quota_used = 0;
     }
-    release(&p->lock);
+    p->quota_used++;
   }
-#ifdef MLFQ
-  for (p = proc; p < &proc[NPROC]; p++)
+  if (p->rt_runtime > 0)
+    edf_charge(p);
+  else if (p->sclass->tick)
+    p->sclass->tick(p);
+}
+
+// Limit the process with the given pid to quota ticks of CPU time
+// in every period ticks, whatever the policy; quota 0 lifts the
+// limit. Returns -1 if there is no such process.
+int setquota(int pid, int quota, int period)
+{
+  struct proc *p;
+
+  if (quota < 0 || (quota > 0 && (period < 1 || quota > period)))
+    return -1;
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  p->quota = quota;
+  p->period = period;
+  p->quota_used = 0;
+  p->period_start = ticks;
+  release(&p->lock);
+  return 0;
+}
+
+// Called on the way back to user space after a timer interrupt.
+// If the current process has used up its quota for this period,
+// sleep until the period ends and the quota is refilled. Processes
+// are only throttled here, never in the kernel, where they might be
+// holding locks others are waiting for.
+void throttle(void)
+{
+  struct proc *p = myproc();
+  uint start, refill;
+
+  if (p->quota == 0 || p->quota_used < p->quota)
+    return;
+  acquire(&tickslock);
+  start = ticks;
+  refill = p->period_start + p->period;
+  timeout_add(p, refill);
+  while ((int)(refill - ticks) > 0 && !killed(p))
+    sleep(&p->timeout, &tickslock);
+  timeout_cancel(p);
+  p->throttled += ticks - start;
+  p->period_start = refill;
+  p->quota_used = 0;
+  release(&tickslock);
+}
+
+// The current process is about to wait for a sleeplock that holder
+// holds. Lend holder its priority, so that holder is not stuck
+// behind processes of lower priority than the waiter while the
+// waiter is stuck behind holder: under MLFQ holder moves up to the
+// waiter's level, and under LBS it draws with the waiter's tickets
+// if it has fewer (and they are in the same currency). The boost
+// lasts until holder releases its last sleeplock, and is not passed
+// on if holder is itself waiting for another one.
+// Caller must hold the sleeplock's spinlock, which keeps holder
+// from releasing it.
+void inherit_priority(struct proc *holder)
+{
+  struct proc *p = myproc();
+
+  acquire(&holder->lock);
+  if (p->sclass == &mlfq_class && holder->sclass == &mlfq_class)
   {
-    // if (p->state == ZOMBIE || p->state == UNUSED || p->killed)
-    //   continue;
-    acquire(&p->lock);
-    if (p->state == RUNNABLE || p->state == RUNNING)
-    {
-      if (p->state == RUNNING)
-      {
-        p->time_in_current_queue++;
-      }
-      // Increment wait time for processes not in the current queue.
-      else if (p->state == RUNNABLE)
-      {
-        p->wait_time++;
-      }
+    // p is running, and its lock is not held, but nobody else
+    // changes a running process's level.
+    int q = mlfq_current(p), old;
 
-      // Demote the process if it exceeds its time slice in its current queue.
-      if (p->time_in_current_queue >= timeslice[p->queue])
+    if (holder->state == RUNNING)
+    {
+      // holder's hart owns its level while it runs, so leave the
+      // level there to be taken up at its next tick or yield.
+      do
       {
-        demote(p);
-        p->time_in_current_queue = 0; // Reset time for new queue.
-      }
+        old = holder->pi_lent;
+        if (old >= 0 && old <= q)
+          break;
+      } while (__sync_val_compare_and_swap(&holder->pi_lent, old, q) != old);
+    }
+    else
+    {
+      int hq = mlfq_level(holder);
 
-      // Promote the process if it has waited too long (aging).
-      if (p->wait_time >= AGING_THRESHOLD)
+      if (q < hq)
       {
-        promote(p);
-        p->wait_time = 0; // Reset wait time after promotion.
+        if (holder->pi_queue < 0)
+          holder->pi_queue = hq;
+        requeue(holder, q);
       }
     }
-    release(&p->lock);
   }
+  acquire(&lottery_lock);
+  if (p->group == holder->group && lottery_weight(p) > lottery_weight(holder))
+  {
+    holder->pi_tickets = lottery_weight(p);
+    lottery_reweigh(holder);
+  }
+  release(&lottery_lock);
+  release(&holder->lock);
+}
 
-  // for (struct proc *pr = proc; pr < &proc[NPROC]; pr++)
-  // {
-  //   if (pr->state == RUNNING || pr->state == RUNNABLE)
-  //   {
-  //     printf("MLFQ %d %d %d %d\n", pr->pid, ticks, pr->queue, pr->state);
-  //   }
-  // }
+// The current process has released its last sleeplock: drop any
+// priority it inherited from waiters.
+void restore_priority(void)
+{
+  struct proc *p = myproc();
 
-#endif
+  acquire(&p->lock);
+  // A level lent since the last tick is no longer needed.
+  __sync_lock_test_and_set(&p->pi_lent, -1);
+  if (p->pi_queue >= 0)
+  {
+    if (p->sclass == &mlfq_class && mlfq_current(p) < p->pi_queue)
+      requeue(p, p->pi_queue);
+    p->pi_queue = -1;
+  }
+  if (p->pi_tickets != 0)
+  {
+    acquire(&lottery_lock);
+    p->pi_tickets = 0;
+    lottery_reweigh(p);
+    release(&lottery_lock);
+  }
+  release(&p->lock);
+}
+
+static void lat_merge(struct lathist *h, struct lathist *from)
+{
+  for (int i = 0; i < NLATBUCKET; i++)
+    h->count[i] += from->count[i];
+  if (from->max > h->max)
+    h->max = from->max;
+}
+
+// Fill in st with the latency histograms of the process with the
+// given pid, or with the system-wide ones since boot if pid is 0.
+// Returns -1 if there is no such process.
+int getlatstat(int pid, struct latstat *st)
+{
+  struct proc *p;
+
+  if (pid == 0)
+  {
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < NCPU; i++)
+    {
+      lat_merge(&st->wait, &cpu_latstat[i].wait);
+      lat_merge(&st->wakeup, &cpu_latstat[i].wakeup);
+      lat_merge(&st->slice, &cpu_latstat[i].slice);
+    }
+    return 0;
+  }
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  *st = *p->lat;
+  release(&p->lock);
+  return 0;
 }
@@ -27,6 +27,18 @@ struct cpu
   struct context context; // swtch() here to enter scheduler().
   int noff;               // Depth of push_off() nesting.
   int intena;             // Were interrupts enabled before push_off()?
+  uint64 picks;           // Scheduling decisions made by this cpu.
+  uint64 pick_cycles;     // Timer cycles spent making them.
+  uint32 rand_state;      // This cpu's lottery PRNG state.
+  int started;            // Has this cpu entered scheduler()?
+  int idle;               // Waiting in wfi for work? Cleared by kick().
+  uint64 idle_cycles;     // Timer cycles spent waiting in wfi.
+  uint64 migrations;      // Processes run here that last ran elsewhere.
+  uint balanced;          // Tick of this cpu's last load balancing.
+  uint kstack_gen;        // kstack_gen when this cpu last flushed its TLB.
+  uint64 run_start;       // Timer value when c->proc started running.
+  struct proc *prev;      // Switched away from by sched(); still locked.
+  uint64 direct;          // Switches from process to process, in sched().
 };
 
 extern struct cpu cpus[NCPU];
@@ -101,12 +113,24 @@ struct proc
   // p->lock must be held when using these:
   enum procstate state; // Process state
   void *chan;           // If non-zero, sleeping on chan
+  struct proc *wnext;   // Links in chan's wait queue,
+  struct proc *wprev;   //   protected by that queue's lock
+  int wqueued;          // In chan's wait queue?
   int killed;           // If non-zero, have been killed
   int xstate;           // Exit status to be returned to parent's wait
   int pid;              // Process ID
+  struct proc *hnext;   // Next in pid's hash chain, proc_lock
+  struct proc *allnext; // Links in the list of live processes,
+  struct proc *allprev; //   protected by proc_lock
+  int slot;             // Kernel stack and lottery slot, < NPROC
 
-  // wait_lock must be held when using this:
-  struct proc *parent; // Parent process
+  // wait_lock must be held when using these:
+  struct proc *parent;   // Parent process
+  struct proc *children; // Live children, linked through sibnext
+  struct proc *zombies;  // Exited children not yet waited for
+  int nzombies;          // Length of zombies
+  struct proc *sibnext;  // Links in the parent's children
+  struct proc *sibprev;  //   or zombies list
   int flagg;
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -121,9 +145,35 @@ struct proc
   uint ctime;                  // When was the process created
   uint etime;                  // When did the process exited
 
+// for sleep(), protected by tickslock
+  uint timeout;     // Tick at which sys_sleep() should return
+  int timeout_index; // Slot in the timeout heap, -1 if not in it
+
 // for LBS
   int tickets;      // For lottery scheduling
   int arrival_time; // To record the arrival time of the process
+  int tree_tickets; // Tickets p holds in the lottery draw, 0 if none
+  int group;        // Lottery currency p's tickets are in, 0 for base
+  uint64 ran_cycles; // Timer cycles p ran for the last time it was dispatched
+
+// for STRIDE
+  uint64 pass;      // Advances by STRIDE1 / tickets per dispatch
+  int heap_index;   // Slot in the stride heap, -1 if not in it
+
+// for CFS
+  uint64 vruntime;  // Ticks run, weighted by 1 / tickets
+  struct proc *rbleft, *rbright, *rbparent; // Links in the CFS tree
+  int rbred;        // Red node in the CFS tree?
+  int rbqueued;     // In the CFS tree?
+
+// for the real-time (EDF) class, protected by the edf lock
+  int rt_runtime;   // Ticks p may run per period, 0 if not real-time
+  int rt_deadline;  // Ticks from the start of a period to its deadline
+  int rt_period;    // Length of a period in ticks
+  uint rt_release;  // Start of the current period
+  uint rt_absdl;    // Deadline of the current period
+  int rt_budget;    // Ticks left to run in the current period
+  struct proc *rtnext; // Link in the EDF ready or throttled list
 
 // for alarmtest
   struct trapframe *backup_trapframe; // to save the current state
@@ -137,10 +187,96 @@ struct proc
   int ticks_used[NMLFQ]; // How many ticks the process has used at each priority level
   int queue;             // Current queue level of the process
   uint64 timeslice;      // Time slice for the current queue level
-  uint64 time_in_current_queue;
-  uint64 wait_time;
+  uint qepoch;           // Boost epoch that queue and ticks_used belong to
+  uint qtime;            // When p joined its current level
+  struct proc *qnext;    // Run queue links, protected by the lock
+  struct proc *qprev;    //   of the MLFQ or RR queue p is on
+  int inqueue;           // Linked into an MLFQ or RR queue?
+  int qcpu;              // Hart whose queues p was last put on
+  int cpu;               // Hart p last ran on
+  int affinity;          // Harts p may run on, a bit each; p->lock
+  int migrations;        // Times p ran on another hart than before
+  uint64 runnable_at;    // Timer cycle p last became RUNNABLE
+  int woken;             // Did it become RUNNABLE by waking up?
+  struct latstat *lat;   // Its latency histograms, under p->lock
+
+  struct sched_class *sclass; // Policy p was last queued by, p->lock
+
+  // CPU bandwidth limit, in ticks; charged by the local hart's tick
+  int quota;             // Ticks p may run per period, 0 for no limit
+  int period;            // Length of a quota period
+  int quota_used;        // Ticks charged in the current period
+  uint period_start;     // When the current period began
+  uint throttled;        // Ticks p has spent throttled
+
+  // Priority inherited from processes waiting for p's sleeplocks
+  int nsleeplocks;       // Sleeplocks p holds; only p changes it
+  int pi_queue;          // MLFQ level p had before a boost, -1 if none
+  int pi_tickets;        // Lottery tickets lent by waiters, 0 if none
+  int pi_lent;           // MLFQ level lent while p was RUNNING, -1 if none
+};
+
+// A lottery currency: a group of processes whose tickets share
+// the group's funding. Protected by lottery_lock.
+struct tgroup
+{
+  int tickets; // Funding, in base tickets
+  int nproc;   // Member processes; free if 0
+};
+
+#define AFFINITY_ALL ((1 << NCPU) - 1)
+
+// May p run on hart id?
+#define ALLOWED(p, id) (((p)->affinity >> (id)) & 1)
+
+// A scheduling policy: the run queue of the RUNNABLE processes it
+// owns and the hooks through which it sees them run. Real-time
+// processes belong to EDF and never reach a class. Every hook that
+// takes a process is called with its p->lock held.
+struct sched_class
+{
+  char *name;
+  // Queue p, which is becoming RUNNABLE: from is SLEEPING if it
+  // is waking up, USED if it is new to this class, and RUNNABLE
+  // if it is only being moved, e.g. after its affinity changed.
+  void (*enqueue)(struct proc *p, int from);
+  // Take p out of the run queue. Returns 0 if p was not on it.
+  int (*dequeue)(struct proc *p);
+  // Take the process that cpu c should run next out of the run
+  // queue, or return 0 if none of those queued may run on c.
+  struct proc *(*pick_next)(struct cpu *c);
+  // Charge the RUNNING process p for one clock tick; may be 0.
+  // Called on the cpu running p, with interrupts off but without
+  // p->lock, so it may only touch fields that p's cpu owns.
+  void (*tick)(struct proc *p);
+  // Queue p again after it gave up the cpu while still runnable.
+  void (*yield)(struct proc *p);
+  // Even out the run queues of the harts by pulling work to cpu c;
+  // called every BALANCE_PERIOD ticks on each cpu. May be 0.
+  void (*balance)(struct cpu *c);
 };
 
-extern struct proc *mlfq[NMLFQ][NPROC]; // Queues for each level of MLFQ
+extern struct sched_class rr_class, lottery_class, mlfq_class;
+extern struct sched_class stride_class, cfs_class;
+extern struct sched_class *sched_class; // Policy for newly runnable processes
+
+// A FIFO threaded through p->qnext and p->qprev: one MLFQ level,
+// or the RR run queue.
+struct runqueue
+{
+  struct proc *head;
+  struct proc *tail;
+  int size;
+};
+
+// Per-CPU MLFQ run queues.
+struct mlfq
+{
+  struct spinlock lock;
+  struct runqueue level[NMLFQ];
+  uint nonempty; // Bit q set if level[q] is non-empty
+  int nproc;     // Processes queued on all levels
+  uint epoch;    // Last boost epoch folded into the levels
+};
 
-extern struct proc proc[NPROC];
+extern struct mlfq mlfqs[NCPU]; // MLFQ queues of each CPU
@@ -0,0 +1,10 @@
+// Per-process statistics, filled in by getprocstat().
+struct procstat {
+  int pid;
+  int cpu;        // hart it last ran on
+  int migrations; // times it ran on another hart than the time before
+  uint rtime;     // ticks it has run for
+  int tickets;    // lottery tickets, in its group's currency
+  uint throttled; // ticks it has spent over its CPU quota
+  int level;      // MLFQ level
+};
@@ -0,0 +1,12 @@
+// Scheduler statistics, filled in by getschedstat().
+// Include param.h first.
+struct schedstat {
+  uint64 picks;             // scheduling decisions made, summed over cpus
+  uint64 pick_cycles;       // timer cycles spent making them
+  uint64 now;               // timer cycles since boot
+  int ncpu;                 // cpus running the scheduler
+  uint64 idle_cycles[NCPU]; // timer cycles each cpu spent idle in wfi
+  char policy[16];          // name of the scheduling policy in use
+  uint64 migrations;        // times a process ran on another cpu than before
+  uint64 direct;            // switches straight from one process to another
+};
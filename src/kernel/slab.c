@@ -0,0 +1,157 @@
+// Kernel object caches.
+//
+// A cache hands out objects of one size. Each page it gets from
+// kalloc() starts with a struct slab and holds as many objects as
+// fit after it; the free ones are chained through their first
+// word. Pages with free objects are on the cache's slabs list. A
+// page whose objects are all free goes back to kalloc(), except
+// that one is kept so a cache that is being used and freed in
+// turn does not call kalloc() every time. So a cache holds memory
+// in proportion to the objects in use, not to the most there
+// have ever been.
+//
+// A cache made with a constructor is type-stable instead: its
+// pages are never given back, each object is set up by the
+// constructor once, when its page is carved, and the free chain
+// runs through a word after each object rather than through the
+// object itself. So a stale pointer to a freed object still points
+// at an object of the same type whose fields, such as a lock, stay
+// usable, and code that can't keep the object alive across a gap
+// need only check that it is still the object it wanted.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;  // On the cache's slabs list.
+  struct slab *prev;
+  void *free;         // Free objects in this page.
+  int inuse;          // Objects handed out from this page.
+  int onlist;         // Is it on the slabs list?
+};
+
+#define FIRST ((sizeof(struct slab) + 7) & ~7)
+
+// The free chain link of object o.
+#define LINK(c, o) (*(void**)((char*)(o) + ((c)->ctor ? (c)->size : 0)))
+
+// Set up c for objects of size bytes. If ctor is not 0, c is
+// type-stable and ctor is called on every object once.
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size, void (*ctor)(void*))
+{
+  initlock(&c->lock, "kmem_cache");
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->ctor = ctor;
+  c->stride = c->size + (ctor ? sizeof(void*) : 0);
+  if(c->size < sizeof(void*) || FIRST + c->stride > PGSIZE)
+    panic("kmem_cache_init");
+  c->slabs = 0;
+  c->empty = 0;
+  c->nslab = 0;
+}
+
+static void
+slab_link(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->slabs;
+  if(c->slabs)
+    c->slabs->prev = s;
+  c->slabs = s;
+  s->onlist = 1;
+}
+
+static void
+slab_unlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->slabs = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->onlist = 0;
+}
+
+// Get a page for c and chain its objects into a free list.
+// Caller must hold c->lock.
+static struct slab *
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+
+  if((s = c->empty) != 0){
+    c->empty = 0;
+    return s;
+  }
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->free = 0;
+  s->inuse = 0;
+  for(o = (char*)s + FIRST; o + c->stride <= (char*)s + PGSIZE; o += c->stride){
+    if(c->ctor)
+      c->ctor(o);
+    LINK(c, o) = s->free;
+    s->free = o;
+  }
+  c->nslab++;
+  return s;
+}
+
+// Allocate an object from c. Its contents are garbage, except
+// for what the constructor of a type-stable cache set up.
+// Returns 0 if there is no memory.
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *o;
+
+  acquire(&c->lock);
+  if((s = c->slabs) == 0){
+    if((s = slab_grow(c)) == 0){
+      release(&c->lock);
+      return 0;
+    }
+    slab_link(c, s);
+  }
+  o = s->free;
+  s->free = LINK(c, o);
+  s->inuse++;
+  if(s->free == 0)
+    slab_unlink(c, s);
+  release(&c->lock);
+  return o;
+}
+
+// Return o, which kmem_cache_alloc(c) handed out, to c.
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+
+  acquire(&c->lock);
+  LINK(c, o) = s->free;
+  s->free = o;
+  s->inuse--;
+  if(!s->onlist)
+    slab_link(c, s);
+  if(s->inuse == 0 && c->ctor == 0){
+    slab_unlink(c, s);
+    if(c->empty == 0){
+      c->empty = s;
+    } else {
+      c->nslab--;
+      kfree(s);
+    }
+  }
+  release(&c->lock);
+}
@@ -0,0 +1,11 @@
+// A cache of equal-sized kernel objects, carved out of pages.
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;         // For debugging.
+  uint size;          // Object size, rounded up to 8 bytes.
+  uint stride;        // Bytes between objects in a page.
+  void (*ctor)(void*); // Type-stable cache: set up each object once.
+  struct slab *slabs; // Pages with a free object.
+  struct slab *empty; // A page with no objects in use, kept for reuse.
+  int nslab;          // Pages owned by the cache, for debugging.
+};
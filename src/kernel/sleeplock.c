@@ -15,29 +15,40 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->holder = 0;
   lk->pid = 0;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+
   acquire(&lk->lk);
   while (lk->locked) {
+    inherit_priority(lk->holder);
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
-  lk->pid = myproc()->pid;
+  lk->holder = p;
+  lk->pid = p->pid;
+  p->nsleeplocks++;
   release(&lk->lk);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->holder = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
+  if (--p->nsleeplocks == 0 && (p->pi_queue >= 0 || p->pi_tickets != 0))
+    restore_priority();
 }
 
 int
@@ -0,0 +1,183 @@
+// Stride scheduling.
+//
+// Each process advances a pass value by its stride, STRIDE1 divided
+// by its tickets, every time it is dispatched, and the RUNNABLE
+// process with the smallest pass runs next. Over any interval a
+// process gets CPU in proportion to its tickets, deterministically
+// rather than only on average as with the lottery.
+//
+// RUNNABLE processes wait in a binary min-heap ordered by pass,
+// so entering, leaving and picking are O(log n). proc.c makes room
+// in the heap for every slot there is, see stride_resize().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define STRIDE1 (1 << 20)
+
+struct {
+  struct spinlock lock;
+  struct proc **heap; // room for every slot, see stride_resize()
+  int n;
+  uint64 pass; // pass of the most recently dispatched process
+} stride;
+
+void
+strideinit(void)
+{
+  initlock(&stride.lock, "stride");
+}
+
+// Move the heap into heap, which has room for every process
+// slot there now is. Returns the old one, for the caller to free.
+struct proc**
+stride_resize(struct proc **heap)
+{
+  struct proc **old;
+
+  acquire(&stride.lock);
+  memmove(heap, stride.heap, stride.n * sizeof(heap[0]));
+  old = stride.heap;
+  stride.heap = heap;
+  release(&stride.lock);
+  return old;
+}
+
+// Does a run before b? Ties go to the lower pid, so the
+// order is fully deterministic.
+static int
+before(struct proc *a, struct proc *b)
+{
+  if(a->pass != b->pass)
+    return a->pass < b->pass;
+  return a->pid < b->pid;
+}
+
+static void
+place(int i, struct proc *p)
+{
+  stride.heap[i] = p;
+  p->heap_index = i;
+}
+
+static void
+siftup(int i)
+{
+  struct proc *p = stride.heap[i];
+
+  while(i > 0 && before(p, stride.heap[(i - 1) / 2])){
+    place(i, stride.heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  place(i, p);
+}
+
+static void
+siftdown(int i)
+{
+  struct proc *p = stride.heap[i];
+  int c;
+
+  while((c = 2 * i + 1) < stride.n){
+    if(c + 1 < stride.n && before(stride.heap[c + 1], stride.heap[c]))
+      c++;
+    if(!before(stride.heap[c], p))
+      break;
+    place(i, stride.heap[c]);
+    i = c;
+  }
+  place(i, p);
+}
+
+// Put a RUNNABLE process into the heap. A process that has been
+// sleeping may not bank the passes it missed, or it would starve
+// everyone else when it wakes, so it rejoins no earlier than the
+// process that ran last.
+// Caller must hold p->lock.
+static void
+stride_enqueue(struct proc *p, int from)
+{
+  acquire(&stride.lock);
+  if(p->heap_index < 0){
+    if(p->pass < stride.pass)
+      p->pass = stride.pass;
+    stride.n++;
+    place(stride.n - 1, p);
+    siftup(stride.n - 1);
+  }
+  release(&stride.lock);
+}
+
+static void
+stride_yield(struct proc *p)
+{
+  stride_enqueue(p, RUNNING);
+}
+
+// Remove the process in slot i of the heap.
+// Caller must hold stride.lock.
+static void
+remove(int i)
+{
+  stride.heap[i]->heap_index = -1;
+  stride.n--;
+  if(i < stride.n){
+    place(i, stride.heap[stride.n]);
+    siftup(i);
+    siftdown(stride.heap[i]->heap_index);
+  }
+}
+
+// Take p out of the heap.
+// Caller must hold p->lock.
+static int
+stride_dequeue(struct proc *p)
+{
+  int queued;
+
+  acquire(&stride.lock);
+  if((queued = p->heap_index >= 0) != 0)
+    remove(p->heap_index);
+  release(&stride.lock);
+  return queued;
+}
+
+// Take the process with the smallest pass that may run on cpu c
+// out of the heap and charge it one stride, or return 0 if there
+// is none. That is the root unless affinity rules it out; only
+// then is the whole heap searched.
+static struct proc*
+stride_pick(struct cpu *c)
+{
+  struct proc *p = 0;
+  int i, id = c - cpus;
+
+  acquire(&stride.lock);
+  if(stride.n > 0 && ALLOWED(stride.heap[0], id)){
+    p = stride.heap[0];
+  } else {
+    for(i = 1; i < stride.n; i++)
+      if(ALLOWED(stride.heap[i], id) && (p == 0 || before(stride.heap[i], p)))
+        p = stride.heap[i];
+  }
+  if(p){
+    remove(p->heap_index);
+    stride.pass = p->pass;
+    p->pass += STRIDE1 / (p->tickets > 0 ? p->tickets : 1);
+  }
+  release(&stride.lock);
+  return p;
+}
+
+struct sched_class stride_class = {
+  .name = "stride",
+  .enqueue = stride_enqueue,
+  .dequeue = stride_dequeue,
+  .pick_next = stride_pick,
+  .yield = stride_yield,
+};
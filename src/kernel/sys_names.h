@@ -1,6 +1,6 @@
 #ifndef SYSCALL_NAMES_H
 #define SYSCALL_NAMES_H
 
-extern int syscall_counts[32];
+extern int syscall_counts[NSYSCALL];
 
 #endif 
@@ -7,7 +7,7 @@
 #include "syscall.h"
 #include "defs.h"
 
-int syscall_counts[32];
+int syscall_counts[NSYSCALL];
 // Fetch the uint64 at addr from the current process.
 int fetchaddr(uint64 addr, uint64 *ip)
 {
@@ -99,6 +99,21 @@ extern uint64 sys_settickets(void);
 extern uint64 sys_getSysCount(void);
 extern uint64 sys_sigalarm(void);
 extern uint64 sys_sigreturn(void);
+extern uint64 sys_getschedstat(void);
+extern uint64 sys_setrealtime(void);
+extern uint64 sys_setscheduler(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_getaffinity(void);
+extern uint64 sys_getcpu(void);
+extern uint64 sys_getprocstat(void);
+extern uint64 sys_newgroup(void);
+extern uint64 sys_fundgroup(void);
+extern uint64 sys_transfertickets(void);
+extern uint64 sys_setquota(void);
+extern uint64 sys_getlatstat(void);
+extern uint64 sys_setboost(void);
+extern uint64 sys_getmemstat(void);
+extern uint64 sys_setdirect(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -130,6 +145,21 @@ static uint64 (*syscalls[])(void) = {
     [SYS_settickets] sys_settickets,
     [SYS_sigalarm] sys_sigalarm,
     [SYS_sigreturn] sys_sigreturn,
+    [SYS_getschedstat] sys_getschedstat,
+    [SYS_setrealtime] sys_setrealtime,
+    [SYS_setscheduler] sys_setscheduler,
+    [SYS_setaffinity] sys_setaffinity,
+    [SYS_getaffinity] sys_getaffinity,
+    [SYS_getcpu] sys_getcpu,
+    [SYS_getprocstat] sys_getprocstat,
+    [SYS_newgroup] sys_newgroup,
+    [SYS_fundgroup] sys_fundgroup,
+    [SYS_transfertickets] sys_transfertickets,
+    [SYS_setquota] sys_setquota,
+    [SYS_getlatstat] sys_getlatstat,
+    [SYS_setboost] sys_setboost,
+    [SYS_getmemstat] sys_getmemstat,
+    [SYS_setdirect] sys_setdirect,
 
 };
 
@@ -27,4 +27,19 @@
 #define SYS_settickets 24
 #define SYS_sigalarm 25
 #define SYS_sigreturn 26
+#define SYS_getschedstat 27
+#define SYS_setrealtime 28
+#define SYS_setscheduler 29
+#define SYS_setaffinity 30
+#define SYS_getaffinity 31
+#define SYS_getcpu 32
+#define SYS_getprocstat 33
+#define SYS_newgroup 34
+#define SYS_fundgroup 35
+#define SYS_transfertickets 36
+#define SYS_setquota 37
+#define SYS_getlatstat 38
+#define SYS_setboost 39
+#define SYS_getmemstat 40
+#define SYS_setdirect 41
 
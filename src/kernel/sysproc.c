@@ -6,6 +6,10 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sys_names.h"
+#include "schedstat.h"
+#include "procstat.h"
+#include "latstat.h"
+#include "memstat.h"
 
 const char *syscall_names[] = {"",
                                "fork",        
@@ -33,16 +37,34 @@ const char *syscall_names[] = {"",
                                "getSysCount", 
                                "settickets",
                                "sigalarm",
-                               "sigreturn"
+                               "sigreturn",
+                               "getschedstat",
+                               "setrealtime",
+                               "setscheduler",
+                               "setaffinity",
+                               "getaffinity",
+                               "getcpu",
+                               "getprocstat",
+                               "newgroup",
+                               "fundgroup",
+                               "transfertickets",
+                               "setquota",
+                               "getlatstat",
+                               "setboost",
+                               "getmemstat",
+                               "setdirect"
 
 };
 
 uint64 sys_settickets(void) {
   int num;
+  struct proc *p = myproc();
   argint(0, &num);
   if (num < 1)
     return -1;
-  myproc()->tickets = num;
+  acquire(&p->lock);
+  set_tickets(p, num);
+  release(&p->lock);
   // printf("Setting %d tickets for process %d\n", num, myproc()->pid);
   return num;
 }
@@ -64,7 +86,7 @@ uint64 sys_getSysCount(void) {
     return -1;
   }
   int op = syscall_counts[syscall_num];
-  for (int i = 0; i < 32; i++)
+  for (int i = 0; i < NSYSCALL; i++)
     syscall_counts[i] = 0;
   if (p->flagg > 0)
     printf("PID %d called %s ", p->pid, syscall_names[syscall_num]);
@@ -103,16 +125,20 @@ uint64 sys_sbrk(void) {
 uint64 sys_sleep(void) {
   int n;
   uint ticks0;
+  struct proc *p = myproc();
 
   argint(0, &n);
   acquire(&tickslock);
   ticks0 = ticks;
+  if (n > 0)
+    timeout_add(p, ticks0 + n);
   while (ticks - ticks0 < n) {
-    if (killed(myproc())) {
+    if (killed(p)) {
+      timeout_cancel(p);
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(&p->timeout, &tickslock);
   }
   release(&tickslock);
   return 0;
@@ -178,4 +204,154 @@ uint64 sys_sigalarm(void) {
   p->alarm_ticks = ticks;
   p->handler = p->trapframe->a1;
   return 0;
-}
\ No newline at end of file
+}
+uint64 sys_getschedstat(void) {
+  uint64 addr;
+  struct schedstat st;
+  struct cpu *c;
+
+  argaddr(0, &addr);
+  memset(&st, 0, sizeof(st));
+  for (c = cpus; c < &cpus[NCPU]; c++) {
+    st.picks += c->picks;
+    st.pick_cycles += c->pick_cycles;
+    st.idle_cycles[c - cpus] = c->idle_cycles;
+    st.migrations += c->migrations;
+    st.direct += c->direct;
+    if (c->started)
+      st.ncpu++;
+  }
+  st.now = r_time();
+  safestrcpy(st.policy, sched_class->name, sizeof(st.policy));
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64 sys_setrealtime(void) {
+  int runtime, deadline, period;
+
+  argint(0, &runtime);
+  argint(1, &deadline);
+  argint(2, &period);
+  return setrealtime(runtime, deadline, period);
+}
+
+uint64 sys_setscheduler(void) {
+  char name[16];
+
+  if (argstr(0, name, sizeof(name)) < 0)
+    return -1;
+  return setscheduler(name);
+}
+
+uint64 sys_setaffinity(void) {
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+uint64 sys_getaffinity(void) {
+  int pid;
+
+  argint(0, &pid);
+  return getaffinity(pid);
+}
+
+// return the hart the caller is running on, which may
+// have changed by the time the caller looks at it.
+uint64 sys_getcpu(void) {
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return id;
+}
+
+uint64 sys_getprocstat(void) {
+  int pid;
+  uint64 addr;
+  struct procstat st;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  if (getprocstat(pid, &st) < 0)
+    return -1;
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64 sys_newgroup(void) {
+  int tickets;
+
+  argint(0, &tickets);
+  return newgroup(tickets);
+}
+
+uint64 sys_fundgroup(void) {
+  int group, tickets;
+
+  argint(0, &group);
+  argint(1, &tickets);
+  return fundgroup(group, tickets);
+}
+
+uint64 sys_transfertickets(void) {
+  int pid, n;
+
+  argint(0, &pid);
+  argint(1, &n);
+  return transfer_tickets(pid, n);
+}
+
+uint64 sys_setquota(void) {
+  int pid, quota, period;
+
+  argint(0, &pid);
+  argint(1, &quota);
+  argint(2, &period);
+  return setquota(pid, quota, period);
+}
+
+uint64 sys_getlatstat(void) {
+  int pid;
+  uint64 addr;
+  struct latstat st;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  if (getlatstat(pid, &st) < 0)
+    return -1;
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64 sys_setboost(void) {
+  int period;
+
+  argint(0, &period);
+  return mlfq_setboost(period);
+}
+
+uint64 sys_getmemstat(void) {
+  uint64 addr;
+  struct memstat st;
+
+  argaddr(0, &addr);
+  kmemstat(&st);
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64 sys_setdirect(void) {
+  int on;
+
+  argint(0, &on);
+  return setdirect(on);
+}
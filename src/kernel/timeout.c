@@ -0,0 +1,127 @@
+// Timeouts for sleep().
+//
+// A process in sys_sleep() waits on its own channel, and its
+// wake-up tick sits in a binary min-heap ordered by deadline.
+// Each clock tick pops only the processes whose deadline has
+// passed and wakes them, rather than waking every sleeper to
+// recheck the time.
+//
+// The heap is protected by tickslock, which the callers already
+// hold to read ticks. proc.c makes room in it for every process
+// slot there is, see timeout_resize().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct {
+  struct proc **heap;
+  int n;
+} timeouts;
+
+// Move the heap into heap, which has room for every process
+// slot there now is. Returns the old one, for the caller to free.
+struct proc**
+timeout_resize(struct proc **heap)
+{
+  struct proc **old;
+
+  acquire(&tickslock);
+  memmove(heap, timeouts.heap, timeouts.n * sizeof(heap[0]));
+  old = timeouts.heap;
+  timeouts.heap = heap;
+  release(&tickslock);
+  return old;
+}
+
+// Is tick a before tick b? Compares the difference, so it
+// stays right when ticks wraps around.
+static int
+before(uint a, uint b)
+{
+  return (int)(a - b) < 0;
+}
+
+static void
+place(int i, struct proc *p)
+{
+  timeouts.heap[i] = p;
+  p->timeout_index = i;
+}
+
+static void
+siftup(int i)
+{
+  struct proc *p = timeouts.heap[i];
+
+  while(i > 0 && before(p->timeout, timeouts.heap[(i - 1) / 2]->timeout)){
+    place(i, timeouts.heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  place(i, p);
+}
+
+static void
+siftdown(int i)
+{
+  struct proc *p = timeouts.heap[i];
+  int c;
+
+  while((c = 2 * i + 1) < timeouts.n){
+    if(c + 1 < timeouts.n &&
+       before(timeouts.heap[c + 1]->timeout, timeouts.heap[c]->timeout))
+      c++;
+    if(!before(timeouts.heap[c]->timeout, p->timeout))
+      break;
+    place(i, timeouts.heap[c]);
+    i = c;
+  }
+  place(i, p);
+}
+
+// Arrange for wakeup(&p->timeout) at tick when.
+// Caller must hold tickslock.
+void
+timeout_add(struct proc *p, uint when)
+{
+  p->timeout = when;
+  timeouts.n++;
+  place(timeouts.n - 1, p);
+  siftup(timeouts.n - 1);
+}
+
+// Take p's timeout out of the heap if it has not fired yet.
+// Caller must hold tickslock.
+void
+timeout_cancel(struct proc *p)
+{
+  int i = p->timeout_index;
+
+  if(i < 0)
+    return;
+  p->timeout_index = -1;
+  timeouts.n--;
+  if(i == timeouts.n)
+    return;
+  place(i, timeouts.heap[timeouts.n]);
+  siftup(i);
+  siftdown(timeouts.heap[i]->timeout_index);
+}
+
+// Wake every process whose timeout is at or before now.
+// Called from clockintr() with tickslock held.
+void
+timeout_expire(uint now)
+{
+  struct proc *p;
+
+  while(timeouts.n > 0 && !before(now, timeouts.heap[0]->timeout)){
+    p = timeouts.heap[0];
+    timeout_cancel(p);
+    wakeup(&p->timeout);
+  }
+}
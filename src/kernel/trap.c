@@ -17,6 +17,9 @@ void kernelvec();
 
 extern int devintr();
 
+// in start.c; timervec sets [id][6] on each of hart id's ticks.
+extern uint64 timer_scratch[NCPU][7];
+
 void trapinit(void) { initlock(&tickslock, "time"); }
 
 // set up to take exceptions and traps while in the kernel.
@@ -107,7 +110,10 @@ void usertrap(void)
   
   // give up the CPU if this is a timer interrupt.
   if (which_dev == 2)
+  {
+    throttle();
     yield();
+  }
   
 
   usertrapret();
@@ -193,7 +199,8 @@ void clockintr()
 {
   acquire(&tickslock);
   ticks++;
-  update_time();
+  edf_tick();
+  mlfq_clock();
   // for (struct proc *p = proc; p < &proc[NPROC]; p++)
   // {
   //   acquire(&p->lock);
@@ -208,7 +215,7 @@ void clockintr()
   //   // }
   //   release(&p->lock);
   // }
-  wakeup(&ticks);
+  timeout_expire(ticks);
   release(&tickslock);
 }
 
@@ -251,17 +258,25 @@ int devintr()
   }
   else if (scause == 0x8000000000000001L)
   {
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt forwarded by timervec in kernelvec.S,
+    // from either a machine-mode timer interrupt or an IPI.
+    int id = cpuid();
+
+    // acknowledge the software interrupt by clearing
+    // the SSIP bit in sip. do it before looking at the tick
+    // flag, so a tick that lands in between raises SSIP again.
+    w_sip(r_sip() & ~2);
+
+    // an IPI only needs to wake the scheduler, which
+    // returning from the interrupt already does.
+    if (__sync_lock_test_and_set(&timer_scratch[id][6], 0) == 0)
+      return 1;
 
-    if (cpuid() == 0)
+    if (id == 0)
     {
       clockintr();
     }
-
-    // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
-    w_sip(r_sip() & ~2);
+    update_time();
 
     return 2;
   }
@@ -33,6 +33,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, so harts can send each other IPIs
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -43,9 +46,6 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
@@ -135,6 +135,22 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
+// add a one-page mapping to the kernel page table, for a
+// kernel stack. the caller flushes the TLBs.
+// returns -1 if a page-table page couldn't be allocated.
+int
+kvmmappage(uint64 va, uint64 pa)
+{
+  return mappages(kernel_pagetable, va, PGSIZE, pa, PTE_R | PTE_W);
+}
+
+// remove a mapping made by kvmmappage() and free its page.
+void
+kvmunmappage(uint64 va)
+{
+  uvmunmap(kernel_pagetable, va, 1, 1);
+}
+
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
@@ -0,0 +1,190 @@
+// Test CPU affinity.
+//
+// usage: affinitytest
+//
+// First a process pinned to the last hart spins next to CPU hogs
+// and checks with getcpu() that it never runs anywhere else. Then a
+// CPU-bound worker runs among the same hogs twice: once sharing all
+// harts with them, and once alone on a hart they are kept off, and
+// the wtime of both runs is printed. In the second run the worker
+// checks that it stays on its hart, and the hogs are checked to
+// have stayed off it.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/schedstat.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+#define CHECKTICKS 50       // how long the pinned process checks for
+#define WORK 50000000       // spin iterations done by the worker
+
+static int ncpu, pin, rest;
+static int hogs[NCPU];
+
+static void
+spin(int n)
+{
+  for(volatile int i = 0; i < n; i++)
+    ;
+}
+
+// Start one CPU hog per hart, restricted to mask if it is nonzero.
+static void
+starthogs(int mask)
+{
+  int i, pid;
+
+  for(i = 0; i < ncpu; i++){
+    if((pid = fork()) < 0){
+      printf("affinitytest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(mask && setaffinity(getpid(), mask) < 0){
+        printf("affinitytest: setaffinity failed\n");
+        exit(1);
+      }
+      for(;;)
+        spin(1000);
+    }
+    hogs[i] = pid;
+  }
+}
+
+// Return the number of hogs whose last hart is outside mask.
+static int
+strayhogs(int mask)
+{
+  struct procstat st;
+  int i, n = 0;
+
+  for(i = 0; i < ncpu; i++)
+    if(getprocstat(hogs[i], &st) < 0 || ((1 << st.cpu) & mask) == 0)
+      n++;
+  return n;
+}
+
+static void
+stophogs(void)
+{
+  int i;
+
+  for(i = 0; i < ncpu; i++)
+    kill(hogs[i]);
+  for(i = 0; i < ncpu; i++)
+    wait(0);
+}
+
+// Exits with the number of times it found itself off its hart,
+// plus the number of times it migrated after being pinned.
+static void
+pinned(void)
+{
+  struct procstat before, after;
+  int end, bad = 0, checks = 0;
+
+  if(setaffinity(getpid(), pin) < 0 || getaffinity(getpid()) != pin){
+    printf("affinitytest: setaffinity failed\n");
+    exit(-1);
+  }
+  getprocstat(getpid(), &before);
+  end = uptime() + CHECKTICKS;
+  while(uptime() < end){
+    if(((1 << getcpu()) & pin) == 0)
+      bad++;
+    checks++;
+    spin(1000);
+  }
+  getprocstat(getpid(), &after);
+  printf("affinitytest: %d checks of the pinned process, %d off its hart, "
+         "%d migrations\n", checks, bad, after.migrations - before.migrations);
+  exit(bad + after.migrations - before.migrations);
+}
+
+// Run the worker among the hogs and return its wtime. When it is
+// isolated, the worker checks every so often that it is on its hart,
+// and the hogs are checked to have stayed off it; the test fails if
+// either ran where it may not.
+static int
+worker(int isolate)
+{
+  struct procstat st;
+  int i, pid, wtime, rtime, xstate, bad = 0;
+
+  starthogs(isolate ? rest : 0);
+  if((pid = fork()) < 0){
+    printf("affinitytest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(isolate && setaffinity(getpid(), pin) < 0){
+      printf("affinitytest: setaffinity failed\n");
+      exit(1);
+    }
+    for(i = 0; i < WORK / 1000; i++){
+      if(isolate && ((1 << getcpu()) & pin) == 0)
+        bad++;
+      spin(1000);
+    }
+    if(isolate && (getprocstat(getpid(), &st) < 0 || ((1 << st.cpu) & pin) == 0))
+      bad++;
+    exit(bad);
+  }
+  while(waitx(&xstate, &wtime, &rtime) != pid)
+    ;
+  if(isolate)
+    bad = strayhogs(rest);
+  stophogs();
+  if(xstate != 0 || bad != 0){
+    printf("affinitytest: isolated worker off its hart %d times, "
+           "%d hogs on its hart\n", xstate, bad);
+    printf("affinitytest: FAILED\n");
+    exit(1);
+  }
+  return wtime;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat st;
+  int pid, xstate, shared, isolated;
+
+  getschedstat(&st);
+  ncpu = st.ncpu;
+  if(ncpu < 2){
+    printf("affinitytest: needs at least 2 CPUs\n");
+    exit(0);
+  }
+  pin = 1 << (ncpu - 1);
+  rest = (1 << ncpu) - 1 - pin;
+
+  if(setaffinity(getpid(), 1 << NCPU) == 0 || setaffinity(-1, pin) == 0){
+    printf("affinitytest: bad setaffinity accepted\n");
+    exit(1);
+  }
+
+  starthogs(0);
+  if((pid = fork()) < 0){
+    printf("affinitytest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0)
+    pinned();
+  while(wait(&xstate) != pid)
+    ;
+  stophogs();
+  if(xstate != 0){
+    printf("affinitytest: FAILED\n");
+    exit(1);
+  }
+
+  shared = worker(0);
+  isolated = worker(1);
+  printf("affinitytest: worker wtime %d sharing all harts, %d isolated\n",
+         shared, isolated);
+  printf("affinitytest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,80 @@
+// Measure page allocation under fork and sbrk on several harts.
+//
+// usage: allocbench [maxworkers]
+//
+// For 1, 2, 4, ... up to maxworkers (default 4) workers at once,
+// each worker NROUND times grows its memory by NPAGE pages and
+// shrinks it again, then forks a child that exits at once. Every
+// worker does the same work, so with an allocator that scales the
+// time per round stays flat as workers are added, up to the number
+// of harts; with one lock for all pages it grows with the workers.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+#define NROUND 200
+#define NPAGE 64
+#define PGSIZE 4096
+#define CYCLES_PER_US 10 // qemu's timer runs at 10 MHz
+
+static void
+work(void)
+{
+  int i, pid;
+
+  for(i = 0; i < NROUND; i++){
+    if(sbrk(NPAGE * PGSIZE) == (char*)-1)
+      exit(1);
+    sbrk(-NPAGE * PGSIZE);
+    if((pid = fork()) < 0)
+      exit(1);
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat before, after;
+  int i, n, max = 4, xstate, failed;
+  uint64 cycles;
+
+  if(argc > 1)
+    max = atoi(argv[1]);
+  if(max < 1 || max > NCPU){
+    fprintf(2, "usage: allocbench [maxworkers], at most %d\n", NCPU);
+    exit(1);
+  }
+  for(n = 1; n <= max; n *= 2){
+    getschedstat(&before);
+    for(i = 0; i < n; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf("allocbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        work();
+    }
+    failed = 0;
+    for(i = 0; i < n; i++){
+      wait(&xstate);
+      failed |= xstate;
+    }
+    getschedstat(&after);
+    if(failed){
+      printf("allocbench: out of memory\n");
+      exit(1);
+    }
+    cycles = after.now - before.now;
+    printf("allocbench: %d workers, %l us per round\n",
+           n, cycles / NROUND / CYCLES_PER_US);
+  }
+  exit(0);
+}
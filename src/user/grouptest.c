@@ -0,0 +1,82 @@
+// Show that a lottery group's share does not grow with its size.
+//
+// usage: grouptest
+//
+// Two tenants run CPU-bound workers for RUNTICKS ticks. Each is a
+// group funded with the same number of tickets, but one runs
+// NWORKER workers and the other a single one. Under LBS both
+// tenants should get about the same CPU time; with flat per-process
+// tickets the big tenant would get NWORKER times as much. One
+// process can use at most one CPU, so the test pins itself and all
+// its workers to hart 0 and they compete for that hart alone.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NWORKER 8
+#define TICKETS 100
+#define RUNTICKS 200
+
+// Run a tenant of n workers in a new group until tick end, and
+// exit with the CPU time they used.
+static void
+tenant(int n, int end)
+{
+  int i, pid, wtime, rtime, total = 0;
+
+  if(newgroup(TICKETS) < 0){
+    printf("grouptest: newgroup failed\n");
+    exit(-1);
+  }
+  for(i = 0; i < n; i++){
+    if((pid = fork()) < 0){
+      printf("grouptest: fork failed\n");
+      exit(-1);
+    }
+    if(pid == 0){
+      while(uptime() < end)
+        ;
+      exit(0);
+    }
+  }
+  for(i = 0; i < n; i++)
+    if(waitx(0, &wtime, &rtime) >= 0)
+      total += rtime;
+  exit(total);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int big, small, end, xstate, rbig = 0, rsmall = 0;
+
+  // Children inherit the mask.
+  if(setaffinity(getpid(), 1) < 0){
+    printf("grouptest: setaffinity failed\n");
+    exit(1);
+  }
+  end = uptime() + RUNTICKS;
+  if((big = fork()) == 0)
+    tenant(NWORKER, end);
+  if((small = fork()) == 0)
+    tenant(1, end);
+  if(big < 0 || small < 0){
+    printf("grouptest: fork failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < 2; i++){
+    int pid = wait(&xstate);
+    if(xstate < 0){
+      printf("grouptest: a tenant failed\n");
+      exit(1);
+    }
+    if(pid == big)
+      rbig = xstate;
+    else if(pid == small)
+      rsmall = xstate;
+  }
+  printf("grouptest: %d workers got %d ticks, 1 worker got %d ticks\n",
+         NWORKER, rbig, rsmall);
+  exit(0);
+}
@@ -0,0 +1,165 @@
+// Print scheduling latency percentiles for each policy.
+//
+// usage: latency [policy ...]
+//
+// Runs the same mix of I/O-bound and CPU-bound children under each
+// policy (all of them by default), merges the children's latency
+// histograms, and prints p50, p99 and max of their run-queue wait,
+// wakeup-to-run latency and slice length. Percentiles are bucket
+// upper bounds, so they are exact to a factor of two. Times are in
+// microseconds of qemu's 10 MHz timer. The policy in use before is
+// restored at the end.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/schedstat.h"
+#include "kernel/latstat.h"
+#include "user/user.h"
+
+#define NIO 5          // children that sleep a tick between short bursts
+#define NCPUBOUND 5    // children that spin
+#define RUNTICKS 50    // how long the children run under each policy
+#define CYCLES_PER_US 10
+
+static char *policies[] = {"rr", "lbs", "mlfq", "stride", "cfs"};
+
+static void
+merge(struct lathist *h, struct lathist *from)
+{
+  int i;
+
+  for(i = 0; i < NLATBUCKET; i++)
+    h->count[i] += from->count[i];
+  if(from->max > h->max)
+    h->max = from->max;
+}
+
+// The latency below which pct percent of those in h fall, rounded
+// up to its bucket's upper bound.
+static uint64
+percentile(struct lathist *h, int pct)
+{
+  uint64 n = 0, seen = 0, want;
+  int i;
+
+  for(i = 0; i < NLATBUCKET; i++)
+    n += h->count[i];
+  want = (n * pct + 99) / 100;
+  for(i = 0; i < NLATBUCKET; i++){
+    seen += h->count[i];
+    if(seen >= want && seen > 0)
+      break;
+  }
+  if(i == NLATBUCKET || (2ull << i) > h->max)
+    return h->max;
+  return 2ull << i;
+}
+
+static void
+show(char *what, struct lathist *h)
+{
+  printf("  %s p50 %l p99 %l max %l\n", what,
+         percentile(h, 50) / CYCLES_PER_US, percentile(h, 99) / CYCLES_PER_US,
+         h->max / CYCLES_PER_US);
+}
+
+// Read exactly n bytes from fd, which a pipe may hand over in
+// pieces no bigger than its buffer. Returns 0 on success.
+static int
+readall(int fd, void *buf, int n)
+{
+  char *p = buf;
+  int r;
+
+  while(n > 0){
+    if((r = read(fd, p, n)) <= 0)
+      return -1;
+    p += r;
+    n -= r;
+  }
+  return 0;
+}
+
+// Run the workload and merge the children's histograms into st.
+// Each child hands its histograms over a shared pipe once it is
+// done; a token passed around on a second pipe keeps their writes,
+// which are larger than the pipe buffer, from interleaving.
+static void
+workload(struct latstat *st)
+{
+  int i, pid, end, res[2], tok[2];
+  struct latstat mine;
+  char c = 0;
+
+  if(pipe(res) < 0 || pipe(tok) < 0){
+    printf("latency: pipe failed\n");
+    exit(1);
+  }
+  write(tok[1], &c, 1);
+  end = uptime() + RUNTICKS;
+  for(i = 0; i < NIO + NCPUBOUND; i++){
+    if((pid = fork()) < 0){
+      printf("latency: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      while(uptime() < end){
+        if(i < NIO){
+          for(volatile int j = 0; j < 10000; j++)
+            ;
+          sleep(1);
+        }
+      }
+      getlatstat(getpid(), &mine);
+      read(tok[0], &c, 1);
+      write(res[1], &mine, sizeof(mine));
+      write(tok[1], &c, 1);
+      exit(0);
+    }
+  }
+  memset(st, 0, sizeof(*st));
+  for(i = 0; i < NIO + NCPUBOUND; i++){
+    if(readall(res[0], &mine, sizeof(mine)) < 0){
+      printf("latency: short read\n");
+      exit(1);
+    }
+    merge(&st->wait, &mine.wait);
+    merge(&st->wakeup, &mine.wakeup);
+    merge(&st->slice, &mine.slice);
+  }
+  for(i = 0; i < NIO + NCPUBOUND; i++)
+    wait(0);
+  close(res[0]);
+  close(res[1]);
+  close(tok[0]);
+  close(tok[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat old;
+  struct latstat st;
+  char **names = policies;
+  int i, n = sizeof(policies) / sizeof(policies[0]);
+
+  if(argc > 1){
+    names = argv + 1;
+    n = argc - 1;
+  }
+  getschedstat(&old);
+  for(i = 0; i < n; i++){
+    if(setscheduler(names[i]) < 0){
+      fprintf(2, "latency: no policy called %s\n", names[i]);
+      continue;
+    }
+    workload(&st);
+    printf("%s (us):\n", names[i]);
+    show("wait  ", &st.wait);
+    show("wakeup", &st.wakeup);
+    show("slice ", &st.slice);
+  }
+  setscheduler(old.policy);
+  exit(0);
+}
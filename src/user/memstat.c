@@ -0,0 +1,37 @@
+// Print physical memory statistics.
+//
+// usage: memstat
+//
+// Prints how many pages are free, how many of those sit on the
+// harts' own lists, and the free blocks of each order of the buddy
+// allocator. For each order it also prints how much of the free
+// memory is in blocks too small to satisfy a request of that
+// order, which is how fragmented memory is for requests that big.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  int k, j, usable;
+
+  if(getmemstat(&st) < 0){
+    printf("memstat: getmemstat failed\n");
+    exit(1);
+  }
+  printf("%d of %d pages free, %d cached by harts\n", st.nfree, st.npage, st.cached);
+  for(k = 0; k < NORDER; k++){
+    usable = 0;
+    for(j = k; j < NORDER; j++)
+      usable += st.nblock[j] << j;
+    if(k == 0)
+      usable += st.cached;
+    printf("order %d (%d pages): %d free blocks, %d%% of free memory too fragmented\n",
+           k, 1 << k, st.nblock[k], st.nfree ? 100 - usable * 100 / st.nfree : 0);
+  }
+  exit(0);
+}
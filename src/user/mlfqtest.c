@@ -0,0 +1,89 @@
+// Test MLFQ priority boosts and allotment accounting.
+//
+// usage: mlfqtest
+//
+// A child tries to game MLFQ by running for a tick or two and then
+// sleeping, over and over. Its ticks add up at each level across
+// the sleeps, so it should still sink towards the bottom level. It
+// then sets a short boost period and sleeps through a boost, after
+// which it should be back at the top. The system runs MLFQ for the
+// duration of the test.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/procstat.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+#define ROUNDS 30 // run-then-sleep rounds of the gaming child
+#define SINK 2    // level it must at least have sunk to
+#define BOOST 10  // boost period for the second part
+
+static int
+level(void)
+{
+  struct procstat st;
+
+  if(getprocstat(getpid(), &st) < 0)
+    return -1;
+  return st.level;
+}
+
+static void
+game(void)
+{
+  int i, t, q;
+
+  for(i = 0; i < ROUNDS; i++){
+    // Spin for at least one whole tick, then give up the CPU.
+    t = uptime();
+    while(uptime() < t + 2)
+      ;
+    sleep(1);
+  }
+  q = level();
+  printf("mlfqtest: level %d after %d rounds of run and sleep\n", q, ROUNDS);
+  if(q < SINK)
+    exit(1);
+
+  if(setboost(BOOST) < 0)
+    exit(1);
+  sleep(3 * BOOST);
+  q = level();
+  printf("mlfqtest: level %d after sleeping through a boost\n", q);
+  exit(q != 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat old;
+  int pid, xstate;
+
+  if(setboost(0) == 0){
+    printf("mlfqtest: bad setboost accepted\n");
+    exit(1);
+  }
+  getschedstat(&old);
+  if(setscheduler("mlfq") < 0 || setboost(1000) < 0){
+    printf("mlfqtest: cannot set up MLFQ\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("mlfqtest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0)
+    game();
+  while(wait(&xstate) != pid)
+    ;
+  setboost(BOOST_PERIOD);
+  setscheduler(old.policy);
+  if(xstate != 0){
+    printf("mlfqtest: FAILED\n");
+    exit(1);
+  }
+  printf("mlfqtest: OK\n");
+  exit(0);
+}
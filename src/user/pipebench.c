@@ -0,0 +1,84 @@
+// Measure pipe ping-pong round trips.
+//
+// usage: pipebench
+//
+// Two processes pinned to the same hart pass a byte back and forth
+// over a pair of pipes NROUND times. Each handoff puts one to sleep
+// and wakes the other, so the round-trip time is mostly the cost of
+// two context switches. The benchmark runs twice, first with direct
+// switches turned off, so that every switch goes through the
+// scheduler thread, then with them on, and prints the time per
+// round trip of each run and how many of its switches went straight
+// from one process to the other.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+#define NROUND 10000
+#define CYCLES_PER_US 10 // qemu's timer runs at 10 MHz
+
+// Time NROUND round trips with direct switches on or off.
+static void
+bench(int direct)
+{
+  struct schedstat before, after;
+  int i, pid, ping[2], pong[2];
+  char c = 0;
+  uint64 cycles;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < NROUND; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+
+  setdirect(direct);
+  getschedstat(&before);
+  for(i = 0; i < NROUND; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("pipebench: ping-pong failed\n");
+      exit(1);
+    }
+  }
+  getschedstat(&after);
+  wait(0);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+
+  cycles = after.now - before.now;
+  printf("pipebench: direct switches %s: %d round trips, %l us each, "
+         "%l of %l switches direct\n", direct ? "on" : "off",
+         NROUND, cycles / NROUND / CYCLES_PER_US, after.direct - before.direct,
+         after.picks - before.picks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int old;
+
+  if(setaffinity(getpid(), 1) < 0){
+    printf("pipebench: setaffinity failed\n");
+    exit(1);
+  }
+  old = setdirect(-1);
+  bench(0);
+  bench(1);
+  setdirect(old);
+  exit(0);
+}
@@ -0,0 +1,121 @@
+// Show priority inheritance for sleeplocks.
+//
+// usage: pitest
+//
+// A low-priority process keeps scanning a large directory, which it
+// does while holding the directory's inode sleeplock, among CPU
+// hogs. A high-priority process that mostly sleeps looks up a file
+// in the same directory now and then and records how long each
+// lookup takes. Without priority inheritance a lookup can wait
+// behind the hogs for as long as the low-priority process does;
+// with it the holder runs at the waiter's priority until it lets go
+// of the lock. Run it with SCHEDULER=MLFQ. It pins itself and all
+// its children to hart 0, so that they compete for one hart even
+// when there are more.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NFILE 100    // files in the directory
+#define NHOG 4       // CPU hogs
+#define SINKTICKS 40 // how long the scanner spins to sink to the bottom
+#define ROUNDS 50    // lookups by the high-priority process
+#define MAXLAT 5     // most ticks a lookup may take
+
+static char name[16] = "pidir/f";
+
+static void
+setname(int i)
+{
+  name[7] = 'a' + i / 26;
+  name[8] = 'a' + i % 26;
+  name[9] = 0;
+}
+
+static int
+spawn(void)
+{
+  int pid;
+
+  if((pid = fork()) < 0){
+    printf("pitest: fork failed\n");
+    exit(1);
+  }
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, t, lat, max = 0, total = 0, end;
+  int pids[NHOG + 1];
+
+  // Children inherit the mask.
+  if(setaffinity(getpid(), 1) < 0){
+    printf("pitest: setaffinity failed\n");
+    exit(1);
+  }
+  if(mkdir("pidir") < 0){
+    printf("pitest: mkdir pidir failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NFILE; i++){
+    setname(i);
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf("pitest: create %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  // The scanner: sink to the lowest level, then look up a missing
+  // name over and over, which reads every entry under the lock.
+  if((pids[0] = spawn()) == 0){
+    end = uptime() + SINKTICKS;
+    while(uptime() < end)
+      ;
+    for(;;)
+      open("pidir/missing", O_RDONLY);
+  }
+  sleep(SINKTICKS);
+  for(i = 1; i <= NHOG; i++)
+    if((pids[i] = spawn()) == 0)
+      for(;;)
+        ;
+
+  setname(0);
+  for(i = 0; i < ROUNDS; i++){
+    sleep(1);
+    t = uptime();
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("pitest: open %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+    lat = uptime() - t;
+    total += lat;
+    if(lat > max)
+      max = lat;
+  }
+
+  for(i = 0; i <= NHOG; i++)
+    kill(pids[i]);
+  for(i = 0; i <= NHOG; i++)
+    wait(0);
+  for(i = 0; i < NFILE; i++){
+    setname(i);
+    unlink(name);
+  }
+  unlink("pidir");
+
+  printf("pitest: %d lookups, %d ticks in all, at most %d\n",
+         ROUNDS, total, max);
+  if(max > MAXLAT){
+    printf("pitest: FAILED\n");
+    exit(1);
+  }
+  printf("pitest: OK\n");
+  exit(0);
+}
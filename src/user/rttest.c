@@ -0,0 +1,152 @@
+// Count missed deadlines of periodic tasks under mixed CPU and I/O load.
+//
+// usage: rttest [-n]
+//
+// By default the periodic tasks reserve their time with setrealtime()
+// and run under EDF. With -n they stay in the normal class, so running
+// rttest -n on an MLFQ kernel shows what MLFQ achieves for the same load.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NRT 3      // periodic tasks
+#define NHOG 4     // CPU-bound processes
+#define NIO 4      // I/O-bound processes
+#define PERIOD 10  // ticks
+#define RUNTIME 2  // ticks reserved per period
+#define NJOBS 20   // periods each task runs for
+
+static int loops_per_tick;
+static int admitted[2]; // each task writes whether it got in
+
+static void
+spin(int n)
+{
+  for(volatile int i = 0; i < n; i++)
+    ;
+}
+
+// Measure how many spin() iterations fit in one tick on an idle system.
+static void
+calibrate(void)
+{
+  int t, n = 0;
+
+  t = uptime();
+  while(uptime() == t)
+    ;
+  t++;
+  while(uptime() == t){
+    spin(1000);
+    n++;
+  }
+  loops_per_tick = n * 1000;
+}
+
+// One periodic task: each job does half a reservation's worth of
+// work and must finish by the end of its period. Reports on the
+// admitted pipe whether it was admitted, and exits with the number
+// of deadlines missed.
+static void
+periodic(int rt)
+{
+  int j, now, release, misses = 0;
+  char ok;
+
+  ok = !rt || setrealtime(RUNTIME, PERIOD, PERIOD) == 0;
+  write(admitted[1], &ok, 1);
+  if(!ok){
+    printf("rttest: task not admitted\n");
+    exit(-1);
+  }
+  release = uptime();
+  for(j = 0; j < NJOBS; j++){
+    spin(loops_per_tick * RUNTIME / 2);
+    if(uptime() > release + PERIOD)
+      misses++;
+    release += PERIOD;
+    now = uptime();
+    if(now < release)
+      sleep(release - now);
+  }
+  exit(misses);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, xstate, rt, misses = 0, overload = 0;
+  int load[NHOG + NIO];
+  char ok;
+
+  rt = !(argc > 1 && strcmp(argv[1], "-n") == 0);
+  if(pipe(admitted) < 0){
+    printf("rttest: pipe failed\n");
+    exit(1);
+  }
+  calibrate();
+
+  for(i = 0; i < NHOG + NIO; i++){
+    if((pid = fork()) < 0){
+      printf("rttest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(;;){
+        if(i >= NHOG)
+          sleep(1);
+        spin(loops_per_tick / 4);
+      }
+    }
+    load[i] = pid;
+  }
+
+  for(i = 0; i < NRT; i++){
+    if((pid = fork()) < 0){
+      printf("rttest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      periodic(rt);
+  }
+
+  // Wait until every task has been through admission control, so
+  // the probe below neither comes first nor crowds a task out.
+  for(i = 0; i < NRT; i++){
+    if(read(admitted[0], &ok, 1) != 1 || !ok){
+      printf("rttest: a task was not admitted\n");
+      for(i = 0; i < NHOG + NIO; i++)
+        kill(load[i]);
+      exit(1);
+    }
+  }
+
+  if(rt){
+    // The tasks hold 3 * 2/10 of a CPU; another 9/10 must not fit.
+    if(setrealtime(9, 10, 10) == 0){
+      printf("rttest: admission control accepted an overload\n");
+      setrealtime(0, 0, 0);
+      overload = 1;
+    } else {
+      printf("rttest: admission control rejected an overload\n");
+    }
+  }
+
+  for(i = 0; i < NRT; i++){
+    wait(&xstate);
+    if(xstate < 0){
+      printf("rttest: a task failed\n");
+      exit(1);
+    }
+    misses += xstate;
+  }
+  for(i = 0; i < NHOG + NIO; i++){
+    kill(load[i]);
+    wait(0);
+  }
+
+  printf("rttest: %d of %d deadlines missed (%s)\n", misses, NRT * NJOBS,
+         rt ? "real-time class" : "normal class");
+  exit(overload);
+}
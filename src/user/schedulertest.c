@@ -1,7 +1,9 @@
 #include "../kernel/types.h"
+#include "../kernel/param.h"
 #include "../kernel/stat.h"
 #include "user.h"
 #include "../kernel/fcntl.h"
+#include "../kernel/schedstat.h"
 
 #define NFORK 10
 #define IO 5
@@ -11,6 +13,11 @@ int main()
   int n, pid;
   int wtime, rtime;
   int twtime = 0, trtime = 0;
+  int wtimes[NFORK], nw = 0, var = 0;
+  struct schedstat before, after;
+  uint64 picks;
+  int start = uptime();
+  getschedstat(&before);
   for (n = 0; n < NFORK; n++)
   {
     pid = fork();
@@ -39,8 +46,22 @@ int main()
     {
       trtime += rtime;
       twtime += wtime;
+      wtimes[nw++] = wtime;
     }
   }
+  for (int i = 0; i < nw; i++)
+    var += (wtimes[i] - twtime / NFORK) * (wtimes[i] - twtime / NFORK);
   printf("Average rtime %d,  wtime %d\n", trtime / NFORK, twtime / NFORK);
+  printf("wtime variance %d\n", nw ? var / nw : 0);
+  printf("Elapsed %d ticks\n", uptime() - start);
+  getschedstat(&after);
+  picks = after.picks - before.picks;
+  printf("Policy %s\n", after.policy);
+  printf("Migrations %l\n", after.migrations - before.migrations);
+  printf("Scheduler picks %l, average pick %l cycles\n", picks,
+         picks ? (after.pick_cycles - before.pick_cycles) / picks : 0);
+  for (int i = 0; i < after.ncpu; i++)
+    printf("CPU %d idle %l%%\n", i,
+           (after.idle_cycles[i] - before.idle_cycles[i]) * 100 / (after.now - before.now));
   exit(0);
 }
\ No newline at end of file
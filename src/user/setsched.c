@@ -0,0 +1,27 @@
+// Show or switch the scheduling policy of the running kernel.
+//
+// usage: setsched [rr|lbs|mlfq|stride|cfs]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat st;
+
+  if(argc > 2){
+    fprintf(2, "usage: setsched [rr|lbs|mlfq|stride|cfs]\n");
+    exit(1);
+  }
+  if(argc == 2 && setscheduler(argv[1]) < 0){
+    fprintf(2, "setsched: no policy called %s\n", argv[1]);
+    exit(1);
+  }
+  getschedstat(&st);
+  printf("%s\n", st.policy);
+  exit(0);
+}
@@ -0,0 +1,51 @@
+// Count the context switches caused by many concurrent sleepers.
+//
+// usage: sleepbench
+//
+// NSLEEPER processes each call sleep(NTICKS) NROUND times while
+// nothing else runs. Every return from sleep() costs at least one
+// switch, so the ideal is about one switch per call; a kernel that
+// wakes every sleeper on every tick needs about NTICKS per call.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+#define NSLEEPER 60
+#define NROUND 5
+#define NTICKS 10
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat before, after;
+  uint64 picks;
+  int i, j, pid, start, calls;
+
+  start = uptime();
+  getschedstat(&before);
+  for(i = 0; i < NSLEEPER; i++){
+    if((pid = fork()) < 0){
+      printf("sleepbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(j = 0; j < NROUND; j++)
+        sleep(NTICKS);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NSLEEPER; i++)
+    wait(0);
+  getschedstat(&after);
+
+  picks = after.picks - before.picks;
+  calls = NSLEEPER * NROUND;
+  printf("sleepbench: %d sleepers, %d calls of sleep(%d) in %d ticks\n",
+         NSLEEPER, calls, NTICKS, uptime() - start);
+  printf("sleepbench: %l context switches, %l per call\n",
+         picks, picks / calls);
+  exit(0);
+}
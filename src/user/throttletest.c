@@ -0,0 +1,55 @@
+// Test CPU bandwidth limits.
+//
+// usage: throttletest
+//
+// A CPU-bound child limited to QUOTA ticks in every PERIOD spins for
+// RUNTICKS ticks of wall-clock time, then reports the CPU time it
+// got and the time it spent throttled. Its CPU time should be about
+// QUOTA / PERIOD of the wall-clock time.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+#define QUOTA 2
+#define PERIOD 10
+#define RUNTICKS 100
+
+int
+main(int argc, char *argv[])
+{
+  struct procstat st;
+  int pid, xstate, end;
+
+  if(setquota(getpid(), PERIOD + 1, PERIOD) == 0 || setquota(getpid(), -1, PERIOD) == 0){
+    printf("throttletest: bad setquota accepted\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("throttletest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(setquota(getpid(), QUOTA, PERIOD) < 0){
+      printf("throttletest: setquota failed\n");
+      exit(1);
+    }
+    end = uptime() + RUNTICKS;
+    while(uptime() < end)
+      ;
+    getprocstat(getpid(), &st);
+    printf("throttletest: ran %d of %d ticks, throttled for %d\n",
+           st.rtime, RUNTICKS, st.throttled);
+    // Allow for a period's worth of slack at either end.
+    exit(st.rtime > RUNTICKS * QUOTA / PERIOD + QUOTA || st.throttled == 0);
+  }
+  while(wait(&xstate) != pid)
+    ;
+  if(xstate != 0){
+    printf("throttletest: FAILED\n");
+    exit(1);
+  }
+  printf("throttletest: OK\n");
+  exit(0);
+}
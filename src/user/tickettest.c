@@ -0,0 +1,83 @@
+// Test lottery ticket transfers.
+//
+// usage: tickettest
+//
+// The parent gives some of its tickets to a child and checks with
+// getprocstat() that they moved and that the child can hand them
+// back. Transfers that would leave the giver without tickets, or
+// that target a process that does not exist, must change nothing.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+#define TICKETS 30
+#define MOVE 20
+
+static int
+tickets(int pid)
+{
+  struct procstat st;
+
+  if(getprocstat(pid, &st) < 0)
+    return -1;
+  return st.tickets;
+}
+
+static void
+check(int ok, char *what)
+{
+  if(!ok){
+    printf("tickettest: %s\n", what);
+    printf("tickettest: FAILED\n");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int parent = getpid(), pid, xstate, p[2];
+  char c;
+
+  check(settickets(TICKETS) == TICKETS, "settickets failed");
+  check(tickets(parent) == TICKETS, "getprocstat does not show tickets");
+
+  if(pipe(p) < 0){
+    printf("tickettest: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("tickettest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // Wait until the parent has given us its tickets, then give
+    // them back.
+    read(p[0], &c, 1);
+    if(transfertickets(parent, MOVE) < 0)
+      exit(1);
+    exit(0);
+  }
+  check(tickets(pid) == 1, "child did not start with one ticket");
+
+  check(transfertickets(pid, TICKETS) < 0, "gave away all tickets");
+  check(transfertickets(pid, 0) < 0, "moved no tickets");
+  check(transfertickets(parent, 1) < 0, "moved tickets to itself");
+  check(transfertickets(1 << 30, MOVE) < 0, "moved tickets to no process");
+  check(tickets(parent) == TICKETS, "failed transfer changed tickets");
+
+  check(transfertickets(pid, MOVE) == 0, "transfer failed");
+  check(tickets(parent) == TICKETS - MOVE, "giver kept its tickets");
+  check(tickets(pid) == 1 + MOVE, "receiver did not get tickets");
+
+  write(p[1], "x", 1);
+  while(wait(&xstate) != pid)
+    ;
+  check(xstate == 0, "child could not give the tickets back");
+  check(tickets(parent) == TICKETS, "tickets did not come back");
+
+  printf("tickettest: OK\n");
+  exit(0);
+}
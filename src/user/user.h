@@ -1,4 +1,8 @@
 struct stat;
+struct schedstat;
+struct procstat;
+struct latstat;
+struct memstat;
 
 // * *
 
@@ -6,6 +10,21 @@ int settickets(int number);
 int getSysCount(int mask);
 int sigalarm(int interval, void (*handler)(void));
 int sigreturn(void) ;
+int getschedstat(struct schedstat*);
+int setrealtime(int runtime, int deadline, int period);
+int setscheduler(const char *name);
+int setaffinity(int pid, int mask);
+int getaffinity(int pid);
+int getcpu(void);
+int getprocstat(int pid, struct procstat*);
+int newgroup(int tickets);
+int fundgroup(int group, int tickets);
+int transfertickets(int pid, int n);
+int setquota(int pid, int quota, int period);
+int getlatstat(int pid, struct latstat*);
+int setboost(int period);
+int getmemstat(struct memstat*);
+int setdirect(int on);
 
 
 
@@ -42,3 +42,18 @@ entry("getSysCount");
 entry("settickets");
 entry("sigalarm");
 entry("sigreturn");
+entry("getschedstat");
+entry("setrealtime");
+entry("setscheduler");
+entry("setaffinity");
+entry("getaffinity");
+entry("getcpu");
+entry("getprocstat");
+entry("newgroup");
+entry("fundgroup");
+entry("transfertickets");
+entry("setquota");
+entry("getlatstat");
+entry("setboost");
+entry("getmemstat");
+entry("setdirect");